@@ -0,0 +1,232 @@
+/// @file bench.cpp
+/// Microbenchmarks of the intersection kernels, BVH traversal and material
+/// scatter functions.
+///
+/// All inputs are generated from fixed seeds, so runs are comparable between
+/// commits. Every benchmark loops over a pool of precomputed rays (or hits),
+/// and reports the median of several timed repetitions. Results are written
+/// as JSON to stdout (or the file given as first argument), progress goes to
+/// stderr.
+///
+/// Statistics counters are switched off while timing, see stats.hpp.
+#include "acceleration/aabb.hpp"
+#include "acceleration/bvh1.hpp"
+#include "acceleration/bvh2.hpp"
+#include "acceleration/bvh3.hpp"
+#include "acceleration/bvh8.hpp"
+#include "hittable.hpp"
+#include "material.hpp"
+#include "ray.hpp"
+#include "rtweekend.hpp"
+#include "shape/quad.hpp"
+#include "shape/sphere.hpp"
+#include "shape/triangle.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Result {
+    std::string name;
+    uint64_t ops;    ///< Operations per repetition
+    double nsPerOp;  ///< Median over the repetitions
+};
+
+/// @brief Number of rays (or hits) each benchmark cycles through.
+constexpr int poolSize    = 4096;
+constexpr int repetitions = 9;
+
+/// @brief Keeps the compiler from removing the benchmarked calls.
+volatile uint64_t sink = 0;
+
+/// @brief Time `ops` calls of `op(i)`, for `i` cycling through the pool.
+/// `op` returns something convertible to an integer that is folded into
+/// `sink`.
+template <typename F>
+Result run(const std::string& name, uint64_t ops, F op)
+{
+    std::vector<double> times;
+    uint64_t acc = 0;
+    // One untimed repetition to warm up caches and branch predictors.
+    for (int rep = -1; rep < repetitions; rep++) {
+        auto tStart = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < ops; i++) acc += op(i % poolSize);
+        auto elapsed = std::chrono::steady_clock::now() - tStart;
+        if (rep >= 0) {
+            times.push_back(
+                std::chrono::duration<double, std::nano>(elapsed).count()
+                / ops);
+        }
+    }
+    sink = sink + acc;
+    std::sort(times.begin(), times.end());
+    Result result { name, ops, times[times.size() / 2] };
+    std::cerr << name << ": " << result.nsPerOp << " ns/op\n";
+    return result;
+}
+
+/// @brief Rays from random points on a sphere of radius `r` around the
+/// origin, aimed at random points inside the unit cube.
+std::vector<Ray> makeRays(uint64_t seed, float r)
+{
+    seedRandom(seed);
+    std::vector<Ray> rays(poolSize);
+    for (Ray& ray : rays) {
+        Vec3 origin = randomUnitVector() * r;
+        Vec3 target = randomVec3(-1.0f, 1.0f);
+        ray         = Ray(origin, target - origin);
+    }
+    return rays;
+}
+
+/// @brief Random triangle soup of small triangles in a 5 unit cube.
+std::vector<shared_ptr<Triangle>>
+makeTriangles(uint64_t seed, int count, shared_ptr<Material> mat)
+{
+    seedRandom(seed);
+    std::vector<shared_ptr<Triangle>> tris(count);
+    for (auto& tri : tris) {
+        Vec3 v0 = randomVec3(-2.5f, 2.5f);
+        tri     = make_shared<Triangle>(
+            v0,
+            v0 + randomVec3(-0.1f, 0.1f),
+            v0 + randomVec3(-0.1f, 0.1f),
+            mat);
+    }
+    return tris;
+}
+
+/// @brief Hits on a unit sphere, for the scatter benchmarks.
+std::vector<HitRecord> makeHits(const std::vector<Ray>& rays)
+{
+    Sphere sphere(Vec3(0.0), 1.0, nullptr);
+    std::vector<HitRecord> hits(rays.size());
+    for (size_t i = 0; i < rays.size(); i++) {
+        if (!sphere.hit(rays[i], 0.001, infinity, hits[i])) {
+            hits[i].p = -rays[i].direction;
+            hits[i].setFaceNormal(rays[i], hits[i].p);
+        }
+    }
+    return hits;
+}
+
+void writeJson(std::ostream& os, const std::vector<Result>& results)
+{
+    os << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        os << "    { \"name\": \"" << r.name << "\", \"ops\": " << r.ops
+           << ", \"ns_per_op\": " << r.nsPerOp
+           << ", \"ops_per_s\": " << 1e9 / r.nsPerOp << " }"
+           << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    stats::enabled = false;
+
+    auto mat  = make_shared<Lambertian>(Color(0.5));
+    auto rays = makeRays(1, 5.0);
+    std::vector<Result> results;
+    HitRecord rec;
+
+    // Primitive kernels
+
+    Aabb box { Vec3(-0.5), Vec3(0.5) };
+    results.push_back(run("Aabb::hit", 1 << 22, [&](int i) {
+        return box.hit(rays[i], 0.001, infinity, rec);
+    }));
+    results.push_back(run("Aabb::intersect", 1 << 22, [&](int i) {
+        return box.intersect(rays[i], 0.001, infinity);
+    }));
+
+    Triangle tri(Vec3(-1, -1, 0), Vec3(1, -1, 0), Vec3(0, 1, 0), mat);
+    results.push_back(run("Triangle::hit", 1 << 22, [&](int i) {
+        return tri.hit(rays[i], 0.001, infinity, rec);
+    }));
+
+    Sphere sphere(Vec3(0.0), 0.8, mat);
+    results.push_back(run("Sphere::hit", 1 << 22, [&](int i) {
+        return sphere.hit(rays[i], 0.001, infinity, rec);
+    }));
+
+    Quad quad(Vec3(-1, -1, 0), Vec3(2, 0, 0), Vec3(0, 2, 0), mat);
+    results.push_back(run("Quad::hit", 1 << 22, [&](int i) {
+        return quad.hit(rays[i], 0.001, infinity, rec);
+    }));
+
+    // BVH traversal over a 10k triangle soup
+
+    auto tris    = makeTriangles(2, 10000, mat);
+    auto bvhRays = makeRays(3, 8.0);
+    std::vector<shared_ptr<Primitive>> prims(tris.begin(), tris.end());
+
+    blikker_basic::BVH bvh1(tris);
+    results.push_back(run("blikker_basic::BVH::hit", 1 << 14, [&](int i) {
+        return bvh1.hit(bvhRays[i], 0.001, infinity, rec);
+    }));
+    blikker_pt2::BVH bvh2(prims);
+    results.push_back(run("blikker_pt2::BVH::hit", 1 << 14, [&](int i) {
+        return bvh2.hit(bvhRays[i], 0.001, infinity, rec);
+    }));
+    blikker_pt3::BVH bvh3(prims);
+    // The traversal orders of --traversal, over the same hierarchy
+    using Traversal = blikker_pt3::BVH::Traversal;
+    auto traverse   = [&](const std::string& name, Traversal traversal) {
+        bvh3.traversal = traversal;
+        results.push_back(run(name, 1 << 14, [&](int i) {
+            return bvh3.hit(bvhRays[i], 0.001, infinity, rec);
+        }));
+    };
+    traverse("blikker_pt3::BVH::hit", Traversal::STACK);
+    traverse("blikker_pt3::BVH::hit ordered", Traversal::ORDERED);
+    traverse("blikker_pt3::BVH::hit stackless", Traversal::STACKLESS);
+    traverse("blikker_pt3::BVH::hit short-stack", Traversal::SHORT_STACK);
+    blikker_pt3::BVH8 bvh8(prims, bvh3);
+    results.push_back(run("blikker_pt3::BVH8::hit", 1 << 14, [&](int i) {
+        return bvh8.hit(bvhRays[i], 0.001, infinity, rec);
+    }));
+
+    // Material scatter
+
+    auto hits = makeHits(rays);
+    Color attenuance;
+    Ray scattered;
+    Lambertian lambertian(Color(0.5));
+    Metal metal(Color(0.5), 0.3);
+    Dielectric dielectric(1.5);
+    seedRandom(5);
+    results.push_back(run("Lambertian::scatter", 1 << 21, [&](int i) {
+        return lambertian.scatter(
+            rays[i].direction, hits[i], attenuance, scattered);
+    }));
+    results.push_back(run("Metal::scatter", 1 << 21, [&](int i) {
+        return metal.scatter(rays[i].direction, hits[i], attenuance, scattered);
+    }));
+    results.push_back(run("Dielectric::scatter", 1 << 21, [&](int i) {
+        return dielectric.scatter(
+            rays[i].direction, hits[i], attenuance, scattered);
+    }));
+
+    if (argc > 1) {
+        std::ofstream f(argv[1]);
+        if (!f.is_open()) {
+            std::cerr << "Failed to open file: " << argv[1] << "\n";
+            return 1;
+        }
+        writeJson(f, results);
+    } else {
+        writeJson(std::cout, results);
+    }
+    return 0;
+}
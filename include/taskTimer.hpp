@@ -1,22 +1,167 @@
+/// @file taskTimer.hpp
+/// Scoped timers, aggregated by hierarchical name.
+///
+/// A ScopedTimer measures its own lifetime on the monotonic clock and adds it
+/// to the TimerRegistry under its name, prefixed by the name of the timer
+/// enclosing it on the same thread: a timer "binning" created while "bvh" and
+/// then "build" are running is recorded as "bvh.build.binning". The registry
+/// keeps count, total, min and max per name, and prints one summary report
+/// when the program exits.
+///
+/// Registering takes a lock and a string, too much for a phase entered once
+/// per BVH node. Such phases sum their time with a ScopedAccumulator instead,
+/// and the enclosing timer reports the sum once with addChild().
+#pragma once
+
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
 
-class TaskTimer {
+class TimerRegistry {
 public:
-    void start(std::string msg) {
-        tStart = std::chrono::system_clock::now();
-        std::cerr << msg;
+    struct Entry {
+        uint64_t count   = 0;
+        uint64_t totalNs = 0;
+        uint64_t minNs   = std::numeric_limits<uint64_t>::max();
+        uint64_t maxNs   = 0;
+    };
+
+    /// @brief The process wide registry, reporting on destruction at exit.
+    static TimerRegistry& instance()
+    {
+        static TimerRegistry registry;
+        return registry;
+    }
+
+    ~TimerRegistry()
+    {
+        if (!entries.empty()) std::cerr << report();
+    }
+
+    void add(const std::string& name, uint64_t ns)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry& e = entries[name];
+        e.count++;
+        e.totalNs += ns;
+        e.minNs = std::min(e.minNs, ns);
+        e.maxNs = std::max(e.maxNs, ns);
+    }
+
+    /// @brief Table of all timers in milliseconds, children indented below
+    /// their parents.
+    std::string report()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(3) << std::left
+           << std::setw(32) << "timer" << std::right << std::setw(8)
+           << "count" << std::setw(12) << "total ms" << std::setw(12)
+           << "min ms" << std::setw(12) << "mean ms" << std::setw(12)
+           << "max ms" << "\n";
+        // Map order puts every name right after its ancestors. Names are
+        // shown relative to their closest recorded ancestor.
+        for (const auto& [name, e] : entries) {
+            size_t depth = 0, labelStart = 0;
+            size_t dot = name.find('.');
+            while (dot != std::string::npos) {
+                if (entries.count(name.substr(0, dot))) {
+                    depth++;
+                    labelStart = dot + 1;
+                }
+                dot = name.find('.', dot + 1);
+            }
+            std::string label =
+                std::string(2 * depth, ' ') + name.substr(labelStart);
+            ss << std::left << std::setw(32) << label << std::right
+               << std::setw(8) << e.count << std::setw(12) << e.totalNs / 1e6
+               << std::setw(12) << e.minNs / 1e6 << std::setw(12)
+               << e.totalNs / 1e6 / e.count << std::setw(12) << e.maxNs / 1e6
+               << "\n";
+        }
+        return ss.str();
     }
-    void stop() {
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now() - tStart);
-        std::cerr << elapsed.count() << "ms\n";
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
     }
-    void stopRestart(std::string msg) {
-        stop();
-        start(msg);
+
+private:
+    std::mutex mutex;
+    std::map<std::string, Entry> entries;
+};
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const std::string& name)
+        : parent(current())
+        , fullName(parent ? parent->fullName + "." + name : name)
+        , start(std::chrono::steady_clock::now())
+    {
+        current() = this;
+    }
+    ~ScopedTimer()
+    {
+        TimerRegistry::instance().add(fullName, elapsedNs());
+        current() = parent;
+    }
+    ScopedTimer(const ScopedTimer&)            = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    /// @brief Time since construction.
+    uint64_t elapsedNs() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - start)
+            .count();
+    }
+    const std::string& name() const { return fullName; }
+
+    /// @brief Record time summed elsewhere as one run of a child timer.
+    void addChild(const std::string& name, uint64_t ns) const
+    {
+        TimerRegistry::instance().add(fullName + "." + name, ns);
+    }
+
+private:
+    /// @brief Innermost running timer of the calling thread.
+    static ScopedTimer*& current()
+    {
+        thread_local ScopedTimer* timer = nullptr;
+        return timer;
+    }
+
+    ScopedTimer* parent;
+    std::string fullName;
+    std::chrono::steady_clock::time_point start;
+};
+
+/// @brief Adds its lifetime to a running total, without registering it.
+class ScopedAccumulator {
+public:
+    explicit ScopedAccumulator(uint64_t& totalNs)
+        : totalNs(totalNs)
+        , start(std::chrono::steady_clock::now())
+    { }
+    ~ScopedAccumulator()
+    {
+        totalNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
     }
+    ScopedAccumulator(const ScopedAccumulator&)            = delete;
+    ScopedAccumulator& operator=(const ScopedAccumulator&) = delete;
 
 private:
-    std::chrono::_V2::system_clock::time_point tStart;
+    uint64_t& totalNs;
+    std::chrono::steady_clock::time_point start;
 };
@@ -5,7 +5,7 @@
 
 bool
 Aabb::hit(const Ray& ray, float tMin, float tMax, HitRecord& rec) const {
-    aabbIntersections++; // Counting total no. of intersections.
+    stats::add(stats::AABB_TESTS);
     float tx1  = (min.x - ray.origin.x) / ray.direction.x;
     float tx2  = (max.x - ray.origin.x) / ray.direction.x;
     float tmin = std::min(tx1, tx2);
@@ -128,6 +128,7 @@ bool blikker_basic::BVH::intersect(
     HitRecord& rec,
     int depth) const {
     const Node& node = nodes[nodeIdx];
+    stats::add(stats::NODE_VISITS);
     // std::cerr << std::string(depth, ' ') << "Node " << nodeIdx << " ";
     if (!node.aabb.intersect(r, tMin, tMax)) return false;
 
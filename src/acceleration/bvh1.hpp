@@ -45,6 +45,17 @@ struct Node {
     size_t right() const { return mLeftChildIdx + 1; }
 };
 
+    /// @brief Node array, valid up to getNodeCount() (node 1 is never used).
+    const Node* getNodes() const { return nodes.data(); }
+    size_t getNodeCount() const { return nodesUsed; }
+    const std::vector<uint32_t>& getPrimIndices() const { return primIndices; }
+    /// @brief Bytes of the node array and primitive indices.
+    size_t memoryBytes() const
+    {
+        return nodes.size() * sizeof(Node)
+             + primIndices.size() * sizeof(uint32_t);
+    }
+
 private:
     /// @brief Update AABB bounds of root node.
     /// @param nodeIdx
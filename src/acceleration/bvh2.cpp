@@ -150,6 +150,7 @@ bool blikker_pt2::BVH::intersect(
     HitRecord& rec,
     int depth) const {
     const Node& node = nodes[nodeIdx];
+    stats::add(stats::NODE_VISITS);
     // std::cerr << std::string(depth, ' ') << "Node " << nodeIdx << " ";
     if (!node.aabb.intersect(r, tMin, tMax)) return false;
 
@@ -200,6 +201,7 @@ bool blikker_pt2::BVH::intersectIterative(
     auto closest = tMax;
 
     for (;;) {
+        stats::add(stats::NODE_VISITS);
         if (node->isLeaf()) {
             // Intersect leaf node's primitives
             for (size_t i = 0; i < node->primCount; i++) {
@@ -2,18 +2,44 @@
 #include "bvh3.hpp"
 
 #include "aabb.hpp"
+#include "perfCounters.hpp"
+#include "taskTimer.hpp"
+#include "trace.hpp"
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <sstream>
 
 namespace blikker_pt3 {
 
+namespace {
+/// @brief Traversal stack entries: popping a node and pushing its children
+/// leaves at most one entry per level, plus one.
+constexpr uint32_t STACK_SIZE = BVH::maxDepth + 1;
+/// @brief Levels whose binning and partitioning are trace zones. Every level
+/// goes through all primitives, so the top ones show where build time goes
+/// without an event per node.
+constexpr uint32_t ZONED_LEVELS = 8;
+} // namespace
+
 BVH::BVH(const std::vector<shared_ptr<Primitive>>& primitives)
     : primitives(primitives)
     , N(primitives.size())
 {
+    build();
+}
+
+void BVH::build()
+{
+    trace::Phase phase("bvh.build", "build", "build");
+    perf::Scope perfScope(perf::BUILD);
+    restored    = false;
+    binningNs   = 0;
+    partitionNs = 0;
     // Upper limit of tree size.
-    nodes.resize(N * 2);
+    nodes.assign(std::max(N * 2, 2u), Node {});
+    nodesUsed = 2;
     // Populate index list
     primIndices.resize(N);
     for (uint32_t i = 0; i < N; i++) primIndices[i] = i;
@@ -23,11 +49,333 @@ BVH::BVH(const std::vector<shared_ptr<Primitive>>& primitives)
     root.firstPrimIdx  = 0;
     root.primCount     = N;
     updateNodeBounds(rootNodeIdx);
+    // Without primitives the root is no leaf, as isLeaf() goes by the count,
+    // and hit() returns before looking at it.
+    if (N == 0) {
+        parents.assign(1, 0);
+        builtCost = 0;
+        builtCosts.clear();
+        return;
+    }
     // std::cerr << "Start recursive subdivide()\n";
-    subdivide(rootNodeIdx);
+    subdivide(rootNodeIdx, 0);
+    phase.scopedTimer().addChild("binning", binningNs);
+    phase.scopedTimer().addChild("partition", partitionNs);
+    layoutDepthFirst();
+    linkParents();
+    recordBuildQuality();
+}
+
+void BVH::layoutDepthFirst()
+{
+    trace::Phase phase("bvh.layout", "build", "layout");
+    std::vector<Node, AlignedAllocator<Node>> ordered(nodesUsed);
+    std::vector<uint32_t> newIdx(nodesUsed, UINT32_MAX);
+    ordered[rootNodeIdx] = nodes[rootNodeIdx];
+    newIdx[rootNodeIdx]  = rootNodeIdx;
+    uint32_t used        = 2;
+
+    uint32_t stack[STACK_SIZE];
+    uint32_t stackPtr = 0;
+    stack[stackPtr++] = rootNodeIdx;
+    while (stackPtr) {
+        Node& node = ordered[stack[--stackPtr]];
+        if (node.isLeaf()) continue;
+        uint32_t left      = node.left();
+        ordered[used]      = nodes[left];
+        ordered[used + 1]  = nodes[left + 1];
+        newIdx[left]       = used;
+        newIdx[left + 1]   = used + 1;
+        node.mLeftChildIdx = used;
+        // Right pushed first, so the left subtree is laid out first
+        stack[stackPtr++] = used + 1;
+        stack[stackPtr++] = used;
+        used += 2;
+    }
+
+    if (!builtCosts.empty()) {
+        std::vector<float> costs(used);
+        for (uint32_t i = 0; i < builtCosts.size(); i++) {
+            if (newIdx[i] != UINT32_MAX) costs[newIdx[i]] = builtCosts[i];
+        }
+        builtCosts = std::move(costs);
+    }
+    ordered.resize(used);
+    nodes     = std::move(ordered);
+    nodesUsed = used;
+}
+
+void BVH::linkParents()
+{
+    parents.assign(nodesUsed / 2, 0);
+    for (uint32_t i = 0; i < nodesUsed; i++) {
+        if (i != 1 && !nodes[i].isLeaf()) parents[nodes[i].left() / 2] = i;
+    }
+}
+
+BVH::BVH(
+    const std::vector<shared_ptr<Primitive>>& primitives,
+    const Node* prebuiltNodes,
+    uint32_t nodeCount,
+    const uint32_t* prebuiltPrimIndices)
+    : nodesUsed(nodeCount)
+    , primitives(primitives)
+    , N(primitives.size())
+{
+    nodes.assign(prebuiltNodes, prebuiltNodes + nodeCount);
+    primIndices.assign(prebuiltPrimIndices, prebuiltPrimIndices + N);
+    if (N == 0 || !validNodes()) {
+        if (N) std::cerr << "Invalid BVH nodes, building instead\n";
+        build();
+        return;
+    }
+    linkParents();
+    recordBuildQuality();
+    restored = true;
+}
+
+bool BVH::validNodes() const
+{
+    if (nodesUsed < 2) return false;
+    // A permutation, or finalize() would move a primitive out twice
+    std::vector<bool> seen(N);
+    for (uint32_t i = 0; i < N; i++) {
+        if (primIndices[i] >= N || seen[primIndices[i]]) return false;
+        seen[primIndices[i]] = true;
+    }
+    struct Entry {
+        uint32_t node;
+        uint32_t depth;
+    };
+    Entry stack[STACK_SIZE];
+    uint32_t stackPtr = 0;
+    stack[stackPtr++] = { rootNodeIdx, 0 };
+    while (stackPtr) {
+        Entry entry      = stack[--stackPtr];
+        const Node& node = nodes[entry.node];
+        if (node.isLeaf()) {
+            if (node.primCount > N || node.firstPrimIdx > N - node.primCount) {
+                return false;
+            }
+            continue;
+        }
+        // Children after their parent also rules out cycles
+        uint32_t left = node.left();
+        if (entry.depth == maxDepth || left % 2 || left <= entry.node
+            || left + 1 >= nodesUsed) {
+            return false;
+        }
+        stack[stackPtr++] = { left, entry.depth + 1 };
+        stack[stackPtr++] = { left + 1, entry.depth + 1 };
+    }
+    return true;
+}
+
+std::vector<uint32_t>
+BVH::finalize(std::vector<shared_ptr<Primitive>>& owner)
+{
+    std::vector<uint32_t> order;
+    if (&owner != &primitives || primIndices.empty()) return order;
+    trace::Phase phase("bvh.finalize", "build", "finalize");
+    std::vector<shared_ptr<Primitive>> ordered(N);
+    for (uint32_t i = 0; i < N; i++) {
+        ordered[i] = std::move(owner[primIndices[i]]);
+    }
+    owner = std::move(ordered);
+    order.swap(primIndices);
+    return order;
+}
+
+float BVH::sahCost() const
+{
+    const Node& root = nodes[rootNodeIdx];
+    if (N == 0 || root.aabb.area() <= 0) return 0;
+    float cost = 0;
+    uint32_t stack[STACK_SIZE];
+    uint32_t stackPtr = 0;
+    stack[stackPtr++] = rootNodeIdx;
+    while (stackPtr) {
+        const Node& node = nodes[stack[--stackPtr]];
+        if (node.isLeaf()) {
+            cost += node.cost();
+        } else {
+            cost += node.aabb.area();
+            stack[stackPtr++] = node.left();
+            stack[stackPtr++] = node.right();
+        }
+    }
+    return cost / root.aabb.area();
+}
+
+std::vector<float> BVH::subtreeCosts() const
+{
+    // Children are allocated after their parent, so a reverse sweep is
+    // bottom-up.
+    std::vector<float> costs(nodesUsed, 0.0f);
+    for (uint32_t i = nodesUsed - 1; i != UINT32_MAX; i--) {
+        const Node& node = nodes[i];
+        if (i == 1) continue;
+        if (node.isLeaf()) {
+            costs[i] = node.primCount;
+            continue;
+        }
+        uint32_t l = node.left();
+        uint32_t r = node.right();
+        float area = node.aabb.area();
+        costs[i]   = area > 0 ? 1
+                                  + (nodes[l].aabb.area() * costs[l]
+                                     + nodes[r].aabb.area() * costs[r])
+                                        / area
+                              : 1 + costs[l] + costs[r];
+    }
+    return costs;
+}
+
+void BVH::recordBuildQuality()
+{
+    builtCost  = sahCost();
+    builtCosts = subtreeCosts();
+}
+
+void BVH::refitInnerNodes()
+{
+    for (uint32_t i = nodesUsed - 1; i != UINT32_MAX; i--) {
+        Node& node = nodes[i];
+        if (i == 1 || node.isLeaf()) continue;
+        node.aabb = nodes[node.left()].aabb;
+        node.aabb.grow(nodes[node.right()].aabb);
+    }
+}
+
+void BVH::subtreeRange(
+    const uint32_t nodeIdx,
+    uint32_t& first,
+    uint32_t& count) const
+{
+    // The primitives of a subtree are a contiguous range: from the leftmost
+    // leaf's first primitive, as many as all its leaves hold.
+    uint32_t leftmost = nodeIdx;
+    while (!nodes[leftmost].isLeaf()) leftmost = nodes[leftmost].left();
+    first = nodes[leftmost].firstPrimIdx;
+    count = 0;
+    uint32_t stack[STACK_SIZE];
+    uint32_t stackPtr = 0;
+    stack[stackPtr++] = nodeIdx;
+    while (stackPtr) {
+        const Node& node = nodes[stack[--stackPtr]];
+        if (node.isLeaf()) {
+            count += node.primCount;
+        } else {
+            stack[stackPtr++] = node.left();
+            stack[stackPtr++] = node.right();
+        }
+    }
+}
+
+void BVH::rebuildSubtree(const uint32_t nodeIdx)
+{
+    // Finalized primitives are in leaf order, which the partitioning starts
+    // from.
+    if (primIndices.empty()) {
+        primIndices.resize(N);
+        for (uint32_t i = 0; i < N; i++) primIndices[i] = i;
+    }
+    uint32_t first, count;
+    subtreeRange(nodeIdx, first, count);
+    // Room for the new descendants, at most two per primitive
+    if (nodes.size() < nodesUsed + 2 * count) {
+        nodes.resize(nodesUsed + 2 * count);
+    }
+    nodes[nodeIdx].firstPrimIdx = first;
+    nodes[nodeIdx].primCount    = count;
+    updateNodeBounds(nodeIdx);
+    subdivide(nodeIdx, depthOf(nodeIdx));
+}
+
+uint32_t BVH::depthOf(uint32_t nodeIdx) const
+{
+    uint32_t depth = 0;
+    for (; nodeIdx != rootNodeIdx; nodeIdx = parents[nodeIdx / 2]) depth++;
+    return depth;
+}
+
+BVH::RefitAction BVH::refit(float maxDegradation)
+{
+    trace::Phase phase("bvh.refit", "build", "refit");
+    if (N == 0) return RefitAction::REFIT;
+
+    // Leaves hold the work, a box per primitive, inner nodes only merge two
+    // boxes each.
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (uint32_t i = 0; i < nodesUsed; i++) {
+        // Node 1 is unused, and unchecked when restored
+        if (i != 1 && nodes[i].isLeaf()) updateNodeBounds(i);
+    }
+    refitInnerNodes();
+
+    if (sahCost() <= maxDegradation * builtCost) return RefitAction::REFIT;
+
+    // Find the highest degraded subtrees holding at most a quarter of the
+    // primitives, descending into the degraded children of larger ones.
+    // Leaves cost their primitive count however they move, so they never
+    // degrade.
+    std::vector<float> costs = subtreeCosts();
+    auto isDegraded          = [&](uint32_t nodeIdx) {
+        return costs[nodeIdx] > maxDegradation * builtCosts[nodeIdx];
+    };
+    std::vector<uint32_t> degraded;
+    uint32_t degradedPrims = 0;
+    uint32_t stack[STACK_SIZE];
+    uint32_t stackPtr = 0;
+    stack[stackPtr++] = rootNodeIdx;
+    while (stackPtr) {
+        uint32_t nodeIdx = stack[--stackPtr];
+        const Node& node = nodes[nodeIdx];
+        if (node.isLeaf() || !isDegraded(nodeIdx)) continue;
+        uint32_t first, count;
+        subtreeRange(nodeIdx, first, count);
+        bool left  = isDegraded(node.left());
+        bool right = isDegraded(node.right());
+        if (4 * count <= N || (!left && !right)) {
+            degraded.push_back(nodeIdx);
+            degradedPrims += count;
+        } else {
+            if (left) stack[stackPtr++] = node.left();
+            if (right) stack[stackPtr++] = node.right();
+        }
+    }
+
+    // Subtrees keep their bounds when rebuilt, so their ancestors need no
+    // refit. New nodes are appended, the old ones dropped by the layout pass.
+    if (!degraded.empty() && degraded[0] != rootNodeIdx
+        && 2 * degradedPrims < N) {
+        uint32_t firstNew = nodesUsed;
+        binningNs         = 0;
+        partitionNs       = 0;
+        for (uint32_t nodeIdx : degraded) rebuildSubtree(nodeIdx);
+        phase.scopedTimer().addChild("binning", binningNs);
+        phase.scopedTimer().addChild("partition", partitionNs);
+        if (sahCost() <= maxDegradation * builtCost) {
+            costs = subtreeCosts();
+            builtCosts.resize(nodesUsed);
+            for (uint32_t nodeIdx : degraded) {
+                builtCosts[nodeIdx] = costs[nodeIdx];
+            }
+            for (uint32_t i = firstNew; i < nodesUsed; i++) {
+                builtCosts[i] = costs[i];
+            }
+            layoutDepthFirst();
+            linkParents();
+            return RefitAction::PARTIAL_REBUILD;
+        }
+    }
+    build();
+    return RefitAction::FULL_REBUILD;
 }
+
 std::string BVH::tree(uint32_t nodeIdx, int depth) const
 {
+    if (N == 0) return "";
     const Node& node = nodes[nodeIdx];
     int indent       = depth;
     std::stringstream os;
@@ -52,15 +400,7 @@ void BVH::updateNodeBounds(const uint32_t nodeIdx)
     node.aabb.max = Vec3(-infinity);
     uint32_t first  = node.firstPrimIdx;
     for (uint32_t i = 0; i < node.primCount; i++) {
-        auto leafPrimIdx = primIndices[first + i];
-        // std::cerr << "updateNodeBounds(" << nodeIdx
-        //           << "): primCount=" << node.primCount
-        //           << " firstPrimIdx=" << node.firstPrimIdx << " i=" << i
-        //           << " leafPrimIdx=" << leafPrimIdx
-        //           << " primitives.size()=" << primitives.size() << "\n";
-        auto leafPrim    = primitives[leafPrimIdx];
-
-        leafPrim->growAABB(node.aabb);
+        leafPrim(first + i)->growAABB(node.aabb);
     }
 }
 
@@ -89,7 +429,7 @@ float BVH::findBestSplitPlane(Node& node, int& axis, float& splitPos)
     // O(N^2) cost, step by uniform intervals for a O(N) cost.
     float bestCost = infinity;
     // ? What is then the best bin count? Would maybe depend on primitive count?
-    uint32_t bins  = 8;
+    uint32_t bins  = binCount;
     for (uint32_t a = 0; a < 3; a++) {
         // Find bounds of primitive centroids
         float boundsMin = infinity;
@@ -152,15 +492,22 @@ float BVH::findBestSplitPlane(Node& node, int& axis, float& splitPos)
     return bestCost;
 }
 
-void BVH::subdivide(const uint32_t nodeIdx)
+void BVH::subdivide(const uint32_t nodeIdx, uint32_t depth)
 {
     Node& node = nodes[nodeIdx];
+    if (depth == maxDepth) return;
     // 1. Determine the axis and position of the split plane, using SAH.
 
     // 1a. Exhaustive SAH evaluation to find best split.
+    const bool zoned = depth < ZONED_LEVELS;
     int axis;       //   = -1;
     float splitPos; // = 0;
-    float splitCost = findBestSplitPlane(node, axis, splitPos);
+    float splitCost;
+    {
+        trace::Zone zone(zoned ? "bvh.binning" : nullptr, "build", nodeIdx);
+        ScopedAccumulator binning(binningNs);
+        splitCost = findBestSplitPlane(node, axis, splitPos);
+    }
 
     // 1b. Evaluate if a split is actually improving from the parent node.
     float noSplitCost = node.cost();
@@ -172,12 +519,16 @@ void BVH::subdivide(const uint32_t nodeIdx)
     // Implementing partition
     int i = node.firstPrimIdx;
     int j = i + node.primCount - 1;
-    while (i <= j) {
-        if (primitives[primIndices[i]]->centroid()[axis] < splitPos) {
-            i++;
-        } else {
-            std::swap(primIndices[i], primIndices[j]);
-            j--;
+    {
+        trace::Zone zone(zoned ? "bvh.partition" : nullptr, "build", nodeIdx);
+        ScopedAccumulator partitioning(partitionNs);
+        while (i <= j) {
+            if (primitives[primIndices[i]]->centroid()[axis] < splitPos) {
+                i++;
+            } else {
+                std::swap(primIndices[i], primIndices[j]);
+                j--;
+            }
         }
     }
 
@@ -207,8 +558,8 @@ void BVH::subdivide(const uint32_t nodeIdx)
         nodes[leftChildIdx].primCount * nodes[leftChildIdx].aabb.area()
         + nodes[rightChildIdx].primCount * nodes[rightChildIdx].aabb.area();
     // 4. Recurse into each of the child nodes.
-    subdivide(leftChildIdx);
-    subdivide(rightChildIdx);
+    subdivide(leftChildIdx, depth + 1);
+    subdivide(rightChildIdx, depth + 1);
 }
 
 bool BVH::intersect(
@@ -220,6 +571,7 @@ bool BVH::intersect(
     int depth) const
 {
     const Node& node = nodes[nodeIdx];
+    stats::add(stats::NODE_VISITS);
     // std::cerr << std::string(depth, ' ') << "Node " << nodeIdx << " ";
     if (!node.aabb.intersect(r, tMin, tMax)) return false;
 
@@ -229,7 +581,7 @@ bool BVH::intersect(
     if (node.isLeaf()) {
         for (uint32_t i = 0; i < node.primCount; i++) {
             // Intersect triangles
-            auto prim = primitives[primIndices[node.firstPrimIdx + i]];
+            const Primitive* prim = leafPrim(node.firstPrimIdx + i);
             if (prim->hit(r, tMin, closest, tempRec)) {
                 // std::cerr << std::string(depth, ' ') << "Hit: prim "
                 //           << node.firstPrimIdx + i << "\n";
@@ -263,7 +615,7 @@ bool BVH::intersectIterative(
     HitRecord& rec) const
 {
     const Node* node = &nodes[rootNodeIdx];
-    const Node* stack[64]; // Magic number stack size
+    const Node* stack[STACK_SIZE];
     uint32_t stackPtr = 0;
 
     bool anyHit = false;
@@ -271,10 +623,11 @@ bool BVH::intersectIterative(
     auto closest = tMax;
 
     for (;;) {
+        stats::add(stats::NODE_VISITS);
         if (node->isLeaf()) {
             // Intersect leaf node's primitives
             for (uint32_t i = 0; i < node->primCount; i++) {
-                auto prim = primitives[primIndices[node->firstPrimIdx + i]];
+                const Primitive* prim = leafPrim(node->firstPrimIdx + i);
                 if (prim->hit(r, tMin, closest, tempRec)) {
                     anyHit  = true;
                     closest = tempRec.t;
@@ -319,4 +672,294 @@ bool BVH::intersectIterative(
     }
 }
 
+bool BVH::intersectOrdered(
+    const Ray& r,
+    const float tMin,
+    const float tMax,
+    HitRecord& rec) const
+{
+    struct Entry {
+        const Node* node;
+        float tEntry;
+    };
+    Entry stack[STACK_SIZE];
+    uint32_t stackPtr = 0;
+    const Node* node  = &nodes[rootNodeIdx];
+
+    bool anyHit = false;
+    HitRecord tempRec;
+    auto closest = tMax;
+    // Next node entered before the closest hit, null if none is left
+    auto pop = [&]() -> const Node* {
+        while (stackPtr) {
+            const Entry& entry = stack[--stackPtr];
+            if (entry.tEntry < closest) return entry.node;
+        }
+        return nullptr;
+    };
+
+    while (node) {
+        stats::add(stats::NODE_VISITS);
+        if (node->isLeaf()) {
+            for (uint32_t i = 0; i < node->primCount; i++) {
+                const Primitive* prim = leafPrim(node->firstPrimIdx + i);
+                if (prim->hit(r, tMin, closest, tempRec)) {
+                    anyHit  = true;
+                    closest = tempRec.t;
+                    rec     = tempRec;
+                }
+            }
+            node = pop();
+            continue;
+        }
+
+        const Node* child1 = &nodes[node->left()];
+        const Node* child2 = &nodes[node->right()];
+        HitRecord dist1, dist2;
+        child1->aabb.hit(r, tMin, closest, dist1);
+        child2->aabb.hit(r, tMin, closest, dist2);
+        if (dist1.t > dist2.t) {
+            std::swap(dist1.t, dist2.t);
+            std::swap(child1, child2);
+        }
+        if (dist1.t == infinity) {
+            node = pop();
+        } else {
+            node = child1;
+            if (dist2.t != infinity) stack[stackPtr++] = { child2, dist2.t };
+        }
+    }
+    return anyHit;
+}
+
+bool BVH::intersectStackless(
+    const Ray& r,
+    const float tMin,
+    const float tMax,
+    HitRecord& rec) const
+{
+    bool anyHit = false;
+    HitRecord tempRec;
+    auto closest  = tMax;
+    auto testLeaf = [&](const Node& node) {
+        for (uint32_t i = 0; i < node.primCount; i++) {
+            const Primitive* prim = leafPrim(node.firstPrimIdx + i);
+            if (prim->hit(r, tMin, closest, tempRec)) {
+                anyHit  = true;
+                closest = tempRec.t;
+                rec     = tempRec;
+            }
+        }
+    };
+
+    const Node& root = nodes[rootNodeIdx];
+    stats::add(stats::NODE_VISITS);
+    if (root.isLeaf()) {
+        testLeaf(root);
+        return anyHit;
+    }
+
+    enum class From { PARENT, SIBLING, CHILD };
+    uint32_t current = nearChild(root, r.direction);
+    From from        = From::PARENT;
+    for (;;) {
+        if (from == From::CHILD) {
+            // Both children of `current` are done
+            if (current == rootNodeIdx) return anyHit;
+            uint32_t parent = parents[current / 2];
+            if (current == nearChild(nodes[parent], r.direction)) {
+                current ^= 1;
+                from = From::SIBLING;
+            } else {
+                current = parent;
+            }
+            continue;
+        }
+
+        const Node& node = nodes[current];
+        HitRecord dist;
+        if (node.aabb.hit(r, tMin, closest, dist)) {
+            stats::add(stats::NODE_VISITS);
+            if (!node.isLeaf()) {
+                current = nearChild(node, r.direction);
+                from    = From::PARENT;
+                continue;
+            }
+            testLeaf(node);
+        }
+        if (from == From::PARENT) {
+            current ^= 1;
+            from = From::SIBLING;
+        } else {
+            current = parents[current / 2];
+            from    = From::CHILD;
+        }
+    }
+}
+
+bool BVH::intersectShortStack(
+    const Ray& r,
+    const float tMin,
+    const float tMax,
+    HitRecord& rec) const
+{
+    struct Entry {
+        uint32_t node;
+        float tEntry;
+    };
+    // Ring buffer, the oldest entry is overwritten when full
+    Entry stack[shortStackSize];
+    uint32_t stackTop  = 0;
+    uint32_t stackSize = 0;
+
+    // Bit per level, the root's the highest. `level` is that of the current
+    // node.
+    constexpr uint64_t ROOT_LEVEL = uint64_t(1) << 63;
+    uint64_t trail                = 0;
+    uint64_t level                = ROOT_LEVEL;
+    uint32_t current              = rootNodeIdx;
+
+    bool anyHit = false;
+    HitRecord tempRec;
+    auto closest = tMax;
+
+    // Mark the node at `level` done and continue at the next one: the
+    // popped one, or on a restart the root.
+    auto pop = [&]() {
+        for (;;) {
+            // Done with the far child at this level carries to the parent's
+            trail &= ~(level - 1);
+            trail += level;
+            if (trail & ROOT_LEVEL) return false;
+            level = trail & (~trail + 1);
+            if (!stackSize) {
+                current = rootNodeIdx;
+                level   = ROOT_LEVEL;
+                return true;
+            }
+            stackTop = (stackTop + shortStackSize - 1) % shortStackSize;
+            stackSize--;
+            const Entry& next = stack[stackTop];
+            if (next.tEntry < closest) {
+                current = next.node;
+                return true;
+            }
+        }
+    };
+
+    for (;;) {
+        const Node& node = nodes[current];
+        stats::add(stats::NODE_VISITS);
+        if (node.isLeaf()) {
+            for (uint32_t i = 0; i < node.primCount; i++) {
+                const Primitive* prim = leafPrim(node.firstPrimIdx + i);
+                if (prim->hit(r, tMin, closest, tempRec)) {
+                    anyHit  = true;
+                    closest = tempRec.t;
+                    rec     = tempRec;
+                }
+            }
+            if (!pop()) return anyHit;
+            continue;
+        }
+
+        // Near and far by entry distance regardless of the closest hit, so a
+        // restart orders them as the first visit did.
+        uint32_t near = node.left();
+        uint32_t far  = node.right();
+        HitRecord distNear, distFar;
+        nodes[near].aabb.hit(r, tMin, infinity, distNear);
+        nodes[far].aabb.hit(r, tMin, infinity, distFar);
+        if (distFar.t < distNear.t) {
+            std::swap(near, far);
+            std::swap(distNear.t, distFar.t);
+        }
+        bool nearLive       = distNear.t < closest;
+        bool farLive        = distFar.t < closest;
+        uint64_t childLevel = level >> 1;
+
+        if (trail & childLevel) {
+            // On a restart. If this is the trail's lowest bit, the near child
+            // is done and the far one is next. Otherwise the walk is inside
+            // the child entered second, which was the near one only if the
+            // far one was not live, and then still is not.
+            level       = childLevel;
+            bool target = !(trail & (childLevel - 1));
+            if (farLive || (nearLive && !target)) {
+                current = farLive ? far : near;
+                continue;
+            }
+        } else if (nearLive || farLive) {
+            // With one child left to enter, it counts as the far one
+            if (nearLive && farLive) {
+                stack[stackTop] = { far, distFar.t };
+                stackTop        = (stackTop + 1) % shortStackSize;
+                stackSize       = std::min(stackSize + 1, shortStackSize);
+            } else {
+                trail |= childLevel;
+            }
+            level   = childLevel;
+            current = nearLive ? near : far;
+            continue;
+        }
+        if (!pop()) return anyHit;
+    }
+}
+
+void BVH::intersectPacket(
+    const RayPacket& packet,
+    const float tMin,
+    HitRecord* recs,
+    bool* hits) const
+{
+    alignas(64) float closest[RayPacket::size];
+    bool mask[RayPacket::size];
+    for (int i = 0; i < RayPacket::size; i++) {
+        // Padding rays get an empty interval and never hit anything.
+        closest[i] = i < packet.count ? infinity : -infinity;
+        if (i < packet.count) hits[i] = false;
+    }
+    // Average direction, for visiting the nearer child first.
+    Vec3 dir(0.0);
+    for (int i = 0; i < packet.count; i++) dir += packet.rays[i].direction;
+    if (N == 0) return;
+
+    uint32_t stack[STACK_SIZE];
+    uint32_t stackPtr = 0;
+    stack[stackPtr++] = rootNodeIdx;
+    HitRecord tempRec;
+    while (stackPtr) {
+        const Node& node = nodes[stack[--stackPtr]];
+        if (packet.frustum.valid && packet.frustum.rejects(node.aabb)) continue;
+        stats::add(stats::NODE_VISITS);
+        stats::add(stats::AABB_TESTS, packet.count);
+        if (!packet.hit(node.aabb, tMin, closest, mask)) continue;
+
+        if (node.isLeaf()) {
+            for (uint32_t p = 0; p < node.primCount; p++) {
+                const Primitive* prim = leafPrim(node.firstPrimIdx + p);
+                for (int i = 0; i < packet.count; i++) {
+                    if (!mask[i]) continue;
+                    if (prim->hit(packet.rays[i], tMin, closest[i], tempRec)) {
+                        hits[i]    = true;
+                        closest[i] = tempRec.t;
+                        recs[i]    = tempRec;
+                    }
+                }
+            }
+            continue;
+        }
+
+        // Push the far child first, so the near child is popped next.
+        uint32_t near = node.left();
+        uint32_t far  = node.right();
+        Aabb nearBox  = nodes[near].aabb;
+        Aabb farBox   = nodes[far].aabb;
+        Vec3 delta    = (farBox.min + farBox.max) - (nearBox.min + nearBox.max);
+        if (glm::dot(delta, dir) < 0) std::swap(near, far);
+        stack[stackPtr++] = far;
+        stack[stackPtr++] = near;
+    }
+}
+
 }; // namespace blikker_pt3
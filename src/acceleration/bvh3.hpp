@@ -7,6 +7,7 @@
 #pragma once
 
 #include "aabb.hpp"
+#include "alignedAllocator.hpp"
 #include "hittable.hpp"
 // #include "hittableList.hpp"
 #include "hittable.hpp"
@@ -24,18 +25,57 @@ public:
     /// for handling triangles in the first place.
     BVH(const std::vector<shared_ptr<Primitive>>& primitives);
 
+    /// @brief Order in which hit() visits the nodes, selectable to compare
+    /// their node visits.
+    enum class Traversal {
+        /// @brief Nearer child first, the other one pushed, see
+        /// intersectIterative().
+        STACK,
+        /// @brief Nearer child first, with entry distances on the stack, see
+        /// intersectOrdered().
+        ORDERED,
+        /// @brief No stack, back up by parent links, see
+        /// intersectStackless().
+        STACKLESS,
+        /// @brief A few stack entries and a restart trail, see
+        /// intersectShortStack().
+        SHORT_STACK,
+    };
+    Traversal traversal = Traversal::STACK;
+
     // Hittable
     bool
     hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const override
     {
+        if (N == 0) return false;
+        switch (traversal) {
+        case Traversal::ORDERED:
+            return intersectOrdered(r, tMin, tMax, rec);
+        case Traversal::STACKLESS:
+            return intersectStackless(r, tMin, tMax, rec);
+        case Traversal::SHORT_STACK:
+            return intersectShortStack(r, tMin, tMax, rec);
+        case Traversal::STACK:
+            break;
+        }
         return intersectIterative(rootNodeIdx, r, tMin, tMax, rec);
     }
+    void hitPacket(
+        const RayPacket& packet,
+        float tMin,
+        HitRecord* recs,
+        bool* hits) const override
+    {
+        intersectPacket(packet, tMin, recs, hits);
+    }
 
     std::string tree(uint32_t nodeIdx, int depth = 0) const;
 
     uint32_t getNodesUsed() const { return nodesUsed - 1; }
 
-    struct Node {
+    /// @brief 32 bytes, so with the node array on a cache line (and node 1
+    /// unused), the two children of a node always share one.
+    struct alignas(32) Node {
         Aabb aabb;
         uint32_t primCount; ///< For a leaf: primitive count, for an inner node: 0
         union {
@@ -48,13 +88,150 @@ public:
         uint32_t right() const { return mLeftChildIdx + 1; }
         float cost() const { return primCount * aabb.area(); }
     };
+    static_assert(sizeof(Node) == 32, "two nodes per cache line");
 
     struct Bin {
         Aabb bounds;
         int primCount = 0;
     };
 
+    /// @brief Number of bins evaluated per axis by the binned SAH builder.
+    static constexpr uint32_t binCount       = 8;
+    /// @brief Bumped whenever the builder changes its output, invalidating
+    /// persisted hierarchies.
+    static constexpr uint32_t builderVersion = 2;
+
+    /// @brief Restore a previously built hierarchy, skipping the build. Nodes
+    /// that are out of range or deeper than maxDepth are rejected, and the
+    /// hierarchy is built instead.
+    /// @param primitives The same primitives, in the same order, as the
+    /// hierarchy was built from.
+    /// @param nodes Node array as returned by getNodes().
+    /// @param nodeCount Number of nodes, as returned by getNodeCount().
+    /// @param primIndices Index array as returned by getPrimIndices().
+    BVH(const std::vector<shared_ptr<Primitive>>& primitives,
+        const Node* nodes,
+        uint32_t nodeCount,
+        const uint32_t* primIndices);
+
+    /// @brief What refit() did to the hierarchy.
+    enum class RefitAction {
+        REFIT,           ///< Bounds updated, topology kept
+        PARTIAL_REBUILD, ///< Degraded subtrees built again over their ranges
+        FULL_REBUILD,
+    };
+
+    /// @brief Update the node bounds after primitives moved, keeping the
+    /// topology: leaves are refitted to their primitives in parallel, then
+    /// inner nodes to their children, bottom-up.
+    ///
+    /// Moving primitives make boxes overlap, so the SAH cost is checked
+    /// afterwards. If it exceeds `maxDegradation` times the cost after the
+    /// build, the lowest subtrees whose own cost degraded that much are built
+    /// again, or, if they hold most primitives or that was not enough, the
+    /// whole hierarchy.
+    /// @param maxDegradation Of the SAH cost, infinity to never rebuild.
+    RefitAction refit(float maxDegradation = 1.5f);
+
+    /// @brief SAH cost of the hierarchy: inner node and primitive tests per
+    /// ray through the root box, counting both as equally expensive.
+    float sahCost() const;
+    /// @brief sahCost() relative to right after the last full build.
+    float degradation() const { return sahCost() / builtCost; }
+
+    /// @brief Permute `primitives`, the vector the hierarchy was built over,
+    /// into leaf order, so leaves address their primitives directly instead
+    /// of through the primitive indices, which are dropped. A build or
+    /// partial rebuild by refit() brings them back.
+    /// @return The dropped indices, the old position of each primitive, or
+    /// nothing if already finalized or `primitives` is another vector.
+    std::vector<uint32_t>
+    finalize(std::vector<shared_ptr<Primitive>>& primitives);
+
+    /// @brief True if the nodes are those given to the restoring constructor,
+    /// false if they were rejected or have been built since.
+    bool isRestored() const { return restored; }
+
+    /// @brief Node array, valid up to getNodeCount() (node 1 is never used).
+    const Node* getNodes() const { return nodes.data(); }
+    uint32_t getNodeCount() const { return nodesUsed; }
+    /// @brief Empty once finalized, then the primitives are in leaf order.
+    const std::vector<uint32_t>& getPrimIndices() const { return primIndices; }
+    /// @brief Bytes of the node array, parent links and primitive indices.
+    size_t memoryBytes() const
+    {
+        return nodes.size() * sizeof(Node)
+             + (parents.size() + primIndices.size()) * sizeof(uint32_t);
+    }
+
+    /// @brief Entries of the stack of Traversal::SHORT_STACK.
+    static constexpr uint32_t shortStackSize = 4;
+    /// @brief Deepest level of a node, the root's being 0. Deeper subtrees
+    /// become leaves, so the traversal stacks have a fixed size and the
+    /// restart trail of Traversal::SHORT_STACK a bit for every level.
+    static constexpr uint32_t maxDepth       = 63;
+
 private:
+    /// @brief Primitive `i` of the leaf order.
+    const Primitive* leafPrim(uint32_t i) const
+    {
+        return primIndices.empty() ? primitives[i].get()
+                                   : primitives[primIndices[i]].get();
+    }
+
+    /// @brief Build over all primitives, replacing any previous hierarchy.
+    void build();
+
+    /// @brief Check restored nodes: children in range and after their
+    /// parent, leaves within the primitives, at most maxDepth levels.
+    bool validNodes() const;
+
+    /// @brief SAH cost of the subtree of each node, relative to the node's
+    /// own box.
+    std::vector<float> subtreeCosts() const;
+
+    /// @brief Remember the SAH costs of a fresh build, the reference of
+    /// refit().
+    void recordBuildQuality();
+
+    /// @brief Refit all inner nodes to their children. Children are always
+    /// allocated after their parent, so a reverse sweep is bottom-up.
+    void refitInnerNodes();
+
+    /// @brief Reorder the nodes depth-first, by sibling pairs in pre-order:
+    /// the children of a left child follow right after its pair, so a descent
+    /// mostly stays on neighbouring cache lines. Children still follow their
+    /// parents. Nodes no longer reachable after partial rebuilds are dropped.
+    void layoutDepthFirst();
+
+    /// @brief Set the parent of every sibling pair, for the stackless
+    /// traversals. Refits keep them, rebuilds and layouts call this again.
+    void linkParents();
+
+    /// @brief Child of inner node `node` whose centre comes first along
+    /// `dir`, the one the stackless traversal enters first. It only depends
+    /// on the ray, so coming back up finds the same one.
+    uint32_t nearChild(const Node& node, const Vec3& dir) const
+    {
+        const Aabb& l = nodes[node.left()].aabb;
+        const Aabb& r = nodes[node.right()].aabb;
+        Vec3 delta    = (r.min + r.max) - (l.min + l.max);
+        return glm::dot(delta, dir) < 0 ? node.right() : node.left();
+    }
+
+    /// @brief Range of primitive indices held by the subtree of `nodeIdx`.
+    void subtreeRange(
+        const uint32_t nodeIdx,
+        uint32_t& first,
+        uint32_t& count) const;
+
+    /// @brief Build the subtree of `nodeIdx` again, over the same range of
+    /// primitive indices. Its old descendants are abandoned.
+    void rebuildSubtree(const uint32_t nodeIdx);
+
+    /// @brief Level of `nodeIdx`, by the parent links.
+    uint32_t depthOf(uint32_t nodeIdx) const;
+
     /// @brief Update AABB bounds of root node.
     /// @param nodeIdx
     void updateNodeBounds(const uint32_t nodeIdx);
@@ -64,7 +241,8 @@ private:
     /// @brief Recursive BVH building. Determine split axis and position, split
     /// and partition primitives, create child nodes and recurse.
     /// @param nodeIdx
-    void subdivide(const uint32_t nodeIdx);
+    /// @param depth Level of the node, which stays a leaf at maxDepth.
+    void subdivide(const uint32_t nodeIdx, uint32_t depth);
 
     /// @brief Recursive intersection function called by hit(). First check if
     /// AABB intersects ray, in which case either; For leaf nodes, compute hit
@@ -89,6 +267,48 @@ private:
         const float tMax,
         HitRecord& rec) const;
 
+    /// @brief Iterative intersection like intersectIterative(), with the
+    /// entry distance of each pushed node on the stack. Children are tested
+    /// against the closest hit so far rather than `tMax`, and popped nodes
+    /// entered beyond it are skipped without a visit.
+    bool intersectOrdered(
+        const Ray& r,
+        const float tMin,
+        const float tMax,
+        HitRecord& rec) const;
+
+    /// @brief Stackless traversal by parent links (Hapala et al. 2011): from
+    /// a node the walk goes down into its near child, across to the far
+    /// sibling once the near one is done, and up once both are. Only the
+    /// current node and where it was entered from are kept per ray.
+    bool intersectStackless(
+        const Ray& r,
+        const float tMin,
+        const float tMax,
+        HitRecord& rec) const;
+
+    /// @brief Traversal with a stack of shortStackSize entries, which drops
+    /// its oldest entry when full (Laine 2010). A 64-bit restart trail holds
+    /// a bit per level, set once the nearer child there is done; when the
+    /// stack runs empty with nodes left, the traversal restarts at the root
+    /// and follows the trail to the next one. The root's bit is the highest,
+    /// so the trail covers maxDepth levels below it.
+    bool intersectShortStack(
+        const Ray& r,
+        const float tMin,
+        const float tMax,
+        HitRecord& rec) const;
+
+    /// @brief Packet traversal. All rays of the packet share one stack. A node
+    /// is skipped if the packet frustum rejects it or no ray's slab test hits
+    /// it, and leaves test their primitives only for the rays that hit the
+    /// leaf box.
+    void intersectPacket(
+        const RayPacket& packet,
+        const float tMin,
+        HitRecord* recs,
+        bool* hits) const;
+
     /// @brief Evaluate SAH for the node on the given split axis and position.
     /// @param axis Split axis
     /// @param pos Split position
@@ -98,15 +318,27 @@ private:
 private:
     uint32_t rootNodeIdx = 0;
     uint32_t nodesUsed   = 2;
-    std::vector<Node> nodes;
+    std::vector<Node, AlignedAllocator<Node>> nodes;
+    /// @brief Parent of each sibling pair, indexed by the pair's left child
+    /// over two (left children have even indices).
+    std::vector<uint32_t> parents;
     /// @brief Reference to list of primitives. Assume that this one can be
     /// shared among subsystems, as so should not be modified.
     const std::vector<shared_ptr<Primitive>>& primitives;
     /// @brief Order of indices into the primitives list. This also allows for
     /// the element size to be decreased (surely won't need 2^64 primitives, or
-    /// even 2^32).
+    /// even 2^32). Empty once finalized.
     std::vector<uint32_t> primIndices;
     /// Primitives size
     uint32_t N;
+    /// @brief sahCost() after the last full build.
+    float builtCost = 0;
+    /// @brief subtreeCosts() when the nodes were built.
+    std::vector<float> builtCosts;
+    bool restored = false;
+    /// @brief Time in findBestSplitPlane() and in partitioning since the
+    /// build started, reported once per build rather than once per node.
+    uint64_t binningNs   = 0;
+    uint64_t partitionNs = 0;
 };
 } // namespace blikker_basic
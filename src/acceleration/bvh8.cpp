@@ -0,0 +1,303 @@
+/// @file Compressed 8-wide BVH implementation
+#include "bvh8.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace blikker_pt3 {
+
+namespace {
+/// @brief Traversal stack entries: a visited node replaces its entry by at
+/// most `width`, so each level on the path leaves at most `width` - 1.
+constexpr int STACK_SIZE = (BVH8::maxDepth + 1) * (BVH8::width - 1) + 1;
+
+/// @brief Slack of the decoded slab distances relative to the size of the
+/// terms summed, covering a few roundings of decoding in the ray's frame.
+constexpr float ROBUSTNESS = 1e-6f;
+
+/// @brief 2^exponent, for exponents of normal floats.
+float step(int exponent)
+{
+    return std::bit_cast<float>(static_cast<uint32_t>(exponent + 127) << 23);
+}
+} // namespace
+
+BVH8::BVH8(
+    const std::vector<shared_ptr<Primitive>>& primitives,
+    const BVH& binary)
+    : primitives(primitives)
+{
+    trace::Phase phase("bvh8.collapse", "build", "collapse");
+    if (primitives.empty()) return;
+    nodes.reserve(binary.getNodeCount() / 4 + 1);
+    primIndices.reserve(primitives.size());
+
+    Source source(binary);
+    nodes.resize(1);
+    collapse(source, 0, source.item(0));
+}
+
+BVH8::BVH8(const std::vector<shared_ptr<Primitive>>& primitives)
+    : BVH8(primitives, BVH(primitives))
+{
+}
+
+std::vector<uint32_t>
+BVH8::finalize(std::vector<shared_ptr<Primitive>>& owner)
+{
+    std::vector<uint32_t> order;
+    if (&owner != &primitives || primIndices.empty()) return order;
+    std::vector<shared_ptr<Primitive>> ordered(primIndices.size());
+    for (size_t i = 0; i < primIndices.size(); i++) {
+        ordered[i] = std::move(owner[primIndices[i]]);
+    }
+    owner = std::move(ordered);
+    order.swap(primIndices);
+    return order;
+}
+
+BVH8::Source::Source(const BVH& binary)
+    : binary(binary)
+    , first(binary.getNodeCount())
+    , count(binary.getNodeCount())
+{
+    // Children are allocated after their parent, so a reverse sweep is
+    // bottom-up.
+    const BVH::Node* nodes = binary.getNodes();
+    for (uint32_t i = binary.getNodeCount() - 1; i != UINT32_MAX; i--) {
+        if (i == 1) continue;
+        const BVH::Node& node = nodes[i];
+        if (node.isLeaf()) {
+            first[i] = node.firstPrimIdx;
+            count[i] = node.primCount;
+        } else {
+            first[i] = std::min(first[node.left()], first[node.right()]);
+            count[i] = count[node.left()] + count[node.right()];
+        }
+    }
+}
+
+BVH8::Item BVH8::Source::item(uint32_t nodeIdx) const
+{
+    const BVH::Node& node = binary.getNodes()[nodeIdx];
+    if (node.isLeaf() || count[nodeIdx] <= leafCollapse) {
+        return { UINT32_MAX, first[nodeIdx], count[nodeIdx], node.aabb };
+    }
+    return { nodeIdx, 0, 0, node.aabb };
+}
+
+void BVH8::expand(
+    const Source& source,
+    const Item& item,
+    std::vector<Item>& out) const
+{
+    if (!item.isLeaf()) {
+        const BVH::Node& node = source.binary.getNodes()[item.node];
+        out.push_back(source.item(node.left()));
+        out.push_back(source.item(node.right()));
+        return;
+    }
+    uint32_t pieces = (item.count + maxLeafSize - 1) / maxLeafSize;
+    pieces          = std::clamp(pieces, 1u, uint32_t(width));
+    for (uint32_t p = 0; p < pieces; p++) {
+        uint32_t first = item.first + uint64_t(item.count) * p / pieces;
+        uint32_t end   = item.first + uint64_t(item.count) * (p + 1) / pieces;
+        Item piece { UINT32_MAX, first, end - first, Aabb() };
+        for (uint32_t i = first; i < end; i++) {
+            primitives[source.primIndex(i)]->growAABB(piece.box);
+        }
+        out.push_back(piece);
+    }
+}
+
+void BVH8::collapse(const Source& source, uint32_t nodeIdx, const Item& item)
+{
+    std::vector<Item> children;
+    expand(source, item, children);
+    // Pull up the children of the largest binary inner node while there is
+    // room, which leaves the fewest large boxes to test.
+    while (children.size() < width) {
+        int best       = -1;
+        float bestArea = -1;
+        for (size_t i = 0; i < children.size(); i++) {
+            float area = children[i].box.area();
+            if (!children[i].isLeaf() && area > bestArea) {
+                best     = i;
+                bestArea = area;
+            }
+        }
+        if (best < 0) break;
+        std::vector<Item> grandchildren;
+        expand(source, children[best], grandchildren);
+        children.erase(children.begin() + best);
+        children.insert(
+            children.begin() + best, grandchildren.begin(),
+            grandchildren.end());
+    }
+
+    Node node {};
+    Aabb box;
+    for (const Item& child : children) box.grow(child.box);
+    node.origin     = box.min;
+    node.childCount = children.size();
+    for (int a = 0; a < 3; a++) {
+        // The smallest step spanning the box in 255 steps
+        float extent = box.max[a] - box.min[a];
+        int e = extent > 0 ? int(std::ceil(std::log2(extent / 255))) : -126;
+        e     = std::clamp(e, -126, 127);
+        while (e < 127 && box.min[a] + 255 * step(e) < box.max[a]) e++;
+        node.exponent[a] = e;
+
+        // Rounded outwards, also after decoding
+        float s = step(e);
+        for (size_t i = 0; i < children.size(); i++) {
+            const Aabb& b = children[i].box;
+            int lo        = int(std::floor((b.min[a] - box.min[a]) / s));
+            int hi        = int(std::ceil((b.max[a] - box.min[a]) / s));
+            lo            = std::clamp(lo, 0, 255);
+            hi            = std::clamp(hi, 0, 255);
+            while (lo > 0 && box.min[a] + lo * s > b.min[a]) lo--;
+            while (hi < 255 && box.min[a] + hi * s < b.max[a]) hi++;
+            node.lo[a][i] = lo;
+            node.hi[a][i] = hi;
+        }
+    }
+
+    // Leaf children refer to primitives in place, inner children become
+    // the next nodes.
+    node.firstPrim      = primIndices.size();
+    uint32_t innerCount = 0;
+    for (size_t i = 0; i < children.size(); i++) {
+        const Item& child = children[i];
+        if (child.isLeaf() && child.count <= maxLeafSize) {
+            node.primCount[i] = child.count;
+            for (uint32_t j = child.first; j < child.first + child.count; j++) {
+                primIndices.push_back(source.primIndex(j));
+            }
+        } else {
+            innerCount++;
+        }
+    }
+    node.firstChild = nodes.size();
+    nodes.resize(nodes.size() + innerCount);
+    nodes[nodeIdx] = node;
+
+    uint32_t childIdx = node.firstChild;
+    for (size_t i = 0; i < children.size(); i++) {
+        if (!node.primCount[i]) collapse(source, childIdx++, children[i]);
+    }
+}
+
+void BVH8::intersectChildren(
+    const Node& node,
+    const Vec3& origin,
+    const Vec3& invDir,
+    float tMin,
+    float tMax,
+    float* tEntry) const
+{
+    // Slab distances of a child plane q steps from the node origin are
+    // q * scale + offset, one multiply-add per plane. Their rounding error
+    // is bounded by that of the terms, whatever the sign of the distance,
+    // so the slabs are widened by it.
+    float scale[3], offset[3], slack[3];
+    for (int a = 0; a < 3; a++) {
+        scale[a]  = step(node.exponent[a]) * invDir[a];
+        offset[a] = (node.origin[a] - origin[a]) * invDir[a];
+        slack[a]  = ROBUSTNESS
+                 * (std::abs(offset[a]) + 255 * std::abs(scale[a]));
+    }
+    int count = node.childCount;
+#pragma omp simd
+    for (int i = 0; i < width; i++) {
+        float x0    = node.lo[0][i] * scale[0] + offset[0];
+        float x1    = node.hi[0][i] * scale[0] + offset[0];
+        float y0    = node.lo[1][i] * scale[1] + offset[1];
+        float y1    = node.hi[1][i] * scale[1] + offset[1];
+        float z0    = node.lo[2][i] * scale[2] + offset[2];
+        float z1    = node.hi[2][i] * scale[2] + offset[2];
+        float tNear = std::max(
+            std::max(std::min(x0, x1) - slack[0], std::min(y0, y1) - slack[1]),
+            std::min(z0, z1) - slack[2]);
+        float tFar = std::min(
+            std::min(std::max(x0, x1) + slack[0], std::max(y0, y1) + slack[1]),
+            std::max(z0, z1) + slack[2]);
+        bool hit  = i < count && tNear <= tFar && tFar > tMin && tNear < tMax;
+        tEntry[i] = hit ? tNear : infinity;
+    }
+}
+
+bool BVH8::hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const
+{
+    if (nodes.empty()) return false;
+    // Axis parallel rays get a huge reciprocal instead of infinity, which
+    // would make the slab distances of planes through the origin NaN.
+    Vec3 invDir;
+    for (int a = 0; a < 3; a++) {
+        float d   = r.direction[a];
+        invDir[a] = 1 / (std::abs(d) > 1e-20f ? d : std::copysign(1e-20f, d));
+    }
+
+    /// A node, or with `count` > 0 a leaf's primitives, entered at `t`.
+    struct Entry {
+        uint32_t index;
+        uint32_t count;
+        float t;
+    };
+    Entry stack[STACK_SIZE];
+    uint32_t stackPtr = 0;
+    stack[stackPtr++] = { 0, 0, tMin };
+
+    bool anyHit = false;
+    HitRecord tempRec;
+    float closest = tMax;
+    while (stackPtr) {
+        Entry entry = stack[--stackPtr];
+        // Entered beyond a hit found since it was pushed
+        if (entry.t >= closest) continue;
+
+        if (entry.count) {
+            for (uint32_t i = entry.index; i < entry.index + entry.count; i++) {
+                if (leafPrim(i)->hit(r, tMin, closest, tempRec)) {
+                    anyHit  = true;
+                    closest = tempRec.t;
+                    rec     = tempRec;
+                }
+            }
+            continue;
+        }
+
+        const Node& node = nodes[entry.index];
+        stats::add(stats::NODE_VISITS);
+        stats::add(stats::AABB_TESTS, node.childCount);
+        alignas(32) float tEntry[width];
+        intersectChildren(node, r.origin, invDir, tMin, closest, tEntry);
+
+        // Sort the children hit by distance, the nearest pushed last so it
+        // is popped first.
+        Entry hits[width];
+        int hitCount      = 0;
+        uint32_t childIdx = node.firstChild;
+        uint32_t primIdx  = node.firstPrim;
+        for (int i = 0; i < node.childCount; i++) {
+            uint32_t count = node.primCount[i];
+            Entry child { count ? primIdx : childIdx, count, tEntry[i] };
+            if (count) {
+                primIdx += count;
+            } else {
+                childIdx++;
+            }
+            if (child.t == infinity) continue;
+            int j = hitCount++;
+            for (; j > 0 && hits[j - 1].t < child.t; j--) hits[j] = hits[j - 1];
+            hits[j] = child;
+        }
+        for (int j = 0; j < hitCount; j++) stack[stackPtr++] = hits[j];
+    }
+    return anyHit;
+}
+
+}; // namespace blikker_pt3
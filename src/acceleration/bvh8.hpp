@@ -0,0 +1,161 @@
+/// @file bvh8.hpp
+/// Compressed 8-wide BVH, for scenes whose binary BVH takes too much memory
+/// and cache.
+///
+/// The hierarchy is collapsed from a blikker_pt3::BVH: each node keeps up to
+/// eight children, pulling up the grandchildren with the largest boxes, and
+/// small subtrees become a single leaf. Child boxes are stored as 8-bit
+/// offsets in a frame spanning the node, with a power of two step per axis,
+/// rounded outwards so they still enclose the children. A node takes 80 bytes
+/// where the binary hierarchy spends 32 per node, and on generated scenes the
+/// node memory shrinks about five to six times. The boxes are decoded on the
+/// fly while testing a ray against all children of a node at once, and the
+/// children hit are visited nearest first.
+#pragma once
+
+#include "aabb.hpp"
+#include "alignedAllocator.hpp"
+#include "bvh3.hpp"
+#include "hittable.hpp"
+#include "rtweekend.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace blikker_pt3 {
+class BVH8 : public Hittable {
+public:
+    /// @brief Children per node.
+    static constexpr int width = 8;
+
+    /// @brief Collapse a binary hierarchy, which can be dropped afterwards.
+    /// @param primitives The primitives `binary` was built over, referred to
+    /// by the compressed hierarchy as well.
+    BVH8(const std::vector<shared_ptr<Primitive>>& primitives,
+         const BVH& binary);
+    /// @brief Build a binary hierarchy over `primitives` and collapse it.
+    explicit BVH8(const std::vector<shared_ptr<Primitive>>& primitives);
+
+    // Hittable
+    bool
+    hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const override;
+
+    /// @brief 80 bytes for up to eight children. Child boxes are given in
+    /// steps of 2^exponent from `origin`, per axis, the lowest corner of the
+    /// node's box.
+    struct alignas(16) Node {
+        Vec3 origin;
+        int8_t exponent[3];
+        uint8_t childCount;
+        /// @brief Index of the first inner child, the others follow it.
+        uint32_t firstChild;
+        /// @brief Index into the primitive indices of the first leaf child,
+        /// the primitives of the others follow its own.
+        uint32_t firstPrim;
+        /// @brief Per child: primitives of a leaf, 0 for an inner node.
+        uint8_t primCount[width];
+        uint8_t lo[3][width]; ///< Per axis and child, box minimum in steps
+        uint8_t hi[3][width]; ///< Per axis and child, box maximum in steps
+    };
+    static_assert(sizeof(Node) == 80, "node layout");
+
+    /// @brief Permute `primitives` into leaf order and drop the primitive
+    /// indices, as BVH::finalize().
+    /// @return The old position of each primitive, or nothing if already
+    /// finalized or `primitives` is another vector.
+    std::vector<uint32_t>
+    finalize(std::vector<shared_ptr<Primitive>>& primitives);
+
+    uint32_t getNodesUsed() const { return nodes.size(); }
+    /// @brief Empty once finalized.
+    const std::vector<uint32_t>& getPrimIndices() const { return primIndices; }
+    /// @brief Bytes of the node array and primitive indices.
+    size_t memoryBytes() const
+    {
+        return nodes.size() * sizeof(Node)
+             + primIndices.size() * sizeof(uint32_t);
+    }
+
+    /// @brief Most primitives of a leaf child, larger leaves of the binary
+    /// hierarchy are split.
+    static constexpr uint32_t maxLeafSize  = 255;
+    /// @brief Binary subtrees of at most this many primitives become one
+    /// leaf child, rather than spending a child slot per primitive.
+    static constexpr uint32_t leafCollapse = 4;
+    /// @brief Deepest level of a node. Every level goes at least one level
+    /// down the binary hierarchy, which stops at BVH::maxDepth, except when
+    /// splitting a binary leaf of up to 2^32 primitives into pieces of at
+    /// most maxLeafSize, which takes up to 8 more.
+    static constexpr uint32_t maxDepth     = BVH::maxDepth + 8;
+
+private:
+    /// @brief Primitive `i` of the leaf order.
+    const Primitive* leafPrim(uint32_t i) const
+    {
+        return primIndices.empty() ? primitives[i].get()
+                                   : primitives[primIndices[i]].get();
+    }
+
+    /// @brief A child of a node being collapsed: an inner node of the binary
+    /// hierarchy, or a range of its primitive indices.
+    struct Item {
+        uint32_t node; ///< Binary inner node, UINT32_MAX for a range
+        uint32_t first;
+        uint32_t count;
+        Aabb box;
+
+        bool isLeaf() const { return node == UINT32_MAX; }
+    };
+
+    /// @brief The binary hierarchy being collapsed, with the range of
+    /// primitive indices held by the subtree of each of its nodes.
+    struct Source {
+        const BVH& binary;
+        std::vector<uint32_t> first;
+        std::vector<uint32_t> count;
+
+        explicit Source(const BVH& binary);
+        /// @brief Primitive `i` of the binary leaf order, which may be
+        /// finalized.
+        uint32_t primIndex(uint32_t i) const
+        {
+            const std::vector<uint32_t>& indices = binary.getPrimIndices();
+            return indices.empty() ? i : indices[i];
+        }
+        /// @brief Binary node `nodeIdx` as a child, a range if it is a leaf
+        /// or holds at most leafCollapse primitives.
+        Item item(uint32_t nodeIdx) const;
+    };
+
+    /// @brief The children of `item`: both children of a binary node, or a
+    /// range cut into pieces of at most maxLeafSize, up to `width` of them.
+    void expand(
+        const Source& source,
+        const Item& item,
+        std::vector<Item>& out) const;
+
+    /// @brief Fill node `nodeIdx` from the children of `item`, pulling up
+    /// grandchildren until it has `width`, and recurse into its inner
+    /// children.
+    void collapse(const Source& source, uint32_t nodeIdx, const Item& item);
+
+    /// @brief Ray against all children of `node` at once, decoding their
+    /// boxes in the ray's frame. Writes the entry distance of every child,
+    /// infinity for those it misses or that start beyond `tMax`.
+    void intersectChildren(
+        const Node& node,
+        const Vec3& origin,
+        const Vec3& invDir,
+        float tMin,
+        float tMax,
+        float* tEntry) const;
+
+    std::vector<Node, AlignedAllocator<Node>> nodes;
+    /// @brief Reference to list of primitives, shared with the binary
+    /// hierarchy the nodes were collapsed from.
+    const std::vector<shared_ptr<Primitive>>& primitives;
+    /// @brief Order of indices into the primitives list, the primitives of
+    /// the leaf children of a node are contiguous. Empty once finalized.
+    std::vector<uint32_t> primIndices;
+};
+} // namespace blikker_pt3
@@ -0,0 +1,163 @@
+#include "bvhCache.hpp"
+
+#include "hash.hpp"
+#include "mappedFile.hpp"
+#include "trace.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace blikker_pt3 {
+
+namespace {
+
+/// @brief Map and validate a cache file. Returns false if it is missing, or
+/// was written for other primitives or another node layout.
+bool loadCache(
+    const std::string& filename,
+    uint64_t key,
+    size_t primCount,
+    MappedFile& f)
+{
+    if (!std::filesystem::exists(filename) || !f.open(filename)) return false;
+    if (f.size() < sizeof(BVHCacheHeader)) return false;
+    auto header = f.at<BVHCacheHeader>(0);
+    if (std::memcmp(header->magic, BVHCacheHeader::expectedMagic, 8) != 0
+        || header->version != BVHCacheHeader::currentVersion
+        || header->nodeSize != sizeof(BVH::Node) || header->key != key
+        || header->primCount != primCount) {
+        std::cerr << "Ignoring stale BVH cache: " << filename << "\n";
+        return false;
+    }
+    // Sections within the file, without overflowing on corrupt offsets
+    auto fits = [&](uint64_t offset, uint64_t bytes) {
+        return offset <= f.size() && bytes <= f.size() - offset;
+    };
+    if (header->nodeCount > UINT32_MAX
+        || !fits(header->nodeOffset, header->nodeCount * sizeof(BVH::Node))
+        || !fits(header->primIndexOffset, primCount * sizeof(uint32_t))) {
+        std::cerr << "BVH cache truncated: " << filename << "\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+uint64_t geometryHash(const std::vector<shared_ptr<Primitive>>& primitives)
+{
+    Fnv1a hash;
+    hash.add(BVH::builderVersion);
+    hash.add(BVH::binCount);
+    hash.add((uint32_t)sizeof(BVH::Node));
+    hash.add((uint64_t)primitives.size());
+    for (const auto& prim : primitives) {
+        Aabb bounds;
+        prim->growAABB(bounds);
+        Vec3 c = prim->centroid();
+        hash.add(&c, sizeof(Vec3));
+        hash.add(&bounds.min, sizeof(Vec3));
+        hash.add(&bounds.max, sizeof(Vec3));
+    }
+    return hash.h;
+}
+
+BVH buildCached(
+    const std::vector<shared_ptr<Primitive>>& primitives,
+    bool* loaded,
+    const std::string& cacheDir)
+{
+    uint64_t key;
+    {
+        trace::Phase phase("bvh.hash", "build", "hash");
+        key = geometryHash(primitives);
+    }
+    std::stringstream ss;
+    ss << cacheDir << "/" << std::hex << std::setw(16) << std::setfill('0')
+       << key << ".rtbvh";
+    std::string filename = ss.str();
+
+    MappedFile f;
+    bool hit;
+    {
+        trace::Phase phase("bvh.cache.load", "io", "cache.load");
+        hit = loadCache(filename, key, primitives.size(), f);
+    }
+    if (loaded) *loaded = false;
+    if (hit) {
+        auto header = f.at<BVHCacheHeader>(0);
+        BVH bvh(
+            primitives,
+            f.at<BVH::Node>(header->nodeOffset),
+            header->nodeCount,
+            f.at<uint32_t>(header->primIndexOffset));
+        if (bvh.isRestored()) {
+            std::cerr << "Loaded BVH of " << header->nodeCount - 1
+                      << " nodes from cache " << filename << "\n";
+            if (loaded) *loaded = true;
+            return bvh;
+        }
+        // Rejected and built instead, replace the cache
+        writeCache(bvh, key, filename);
+        return bvh;
+    }
+
+    BVH bvh(primitives);
+    std::error_code ec;
+    std::filesystem::create_directories(cacheDir, ec);
+    writeCache(bvh, key, filename);
+    return bvh;
+}
+
+bool writeCache(const BVH& bvh, uint64_t key, const std::string& filename)
+{
+    trace::Phase phase("bvh.cache.write", "io", "cache.write");
+    BVHCacheHeader header;
+    std::memcpy(header.magic, BVHCacheHeader::expectedMagic, 8);
+    header.version   = BVHCacheHeader::currentVersion;
+    header.nodeSize  = sizeof(BVH::Node);
+    header.key       = key;
+    header.primCount = bvh.getPrimIndices().size();
+    header.nodeCount = bvh.getNodeCount();
+
+    uint64_t nodeBytes     = sizeof(BVH::Node) * header.nodeCount;
+    uint64_t primBytes     = sizeof(uint32_t) * header.primCount;
+    header.nodeOffset      = alignSection(sizeof(BVHCacheHeader));
+    header.primIndexOffset = alignSection(header.nodeOffset + nodeBytes);
+
+    // Write to a temporary name first, so concurrent runs never map a
+    // partially written cache.
+    std::string tmpFilename = filename + ".tmp";
+    std::ofstream f(tmpFilename, std::ios::binary | std::ios::trunc);
+    if (!f.is_open()) {
+        std::cerr << "Failed to open file: " << tmpFilename << "\n";
+        return false;
+    }
+    f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeSection(f, header.nodeOffset, bvh.getNodes(), nodeBytes);
+    writeSection(
+        f,
+        header.primIndexOffset,
+        bvh.getPrimIndices().data(),
+        primBytes);
+    f.close();
+    std::error_code ec;
+    if (!f.good()) {
+        std::cerr << "Failed to write BVH cache: " << tmpFilename << "\n";
+        std::filesystem::remove(tmpFilename, ec);
+        return false;
+    }
+    std::filesystem::rename(tmpFilename, filename, ec);
+    if (ec) {
+        std::cerr << "Failed to write BVH cache: " << filename << "\n";
+        return false;
+    }
+    std::cerr << "Wrote BVH cache " << filename << "\n";
+    return true;
+}
+
+} // namespace blikker_pt3
@@ -0,0 +1,54 @@
+/// @file bvhCache.hpp
+/// On-disk cache of built blikker_pt3::BVH hierarchies.
+///
+/// The build is a deterministic function of the primitive centroids and
+/// bounds, in order, and of the builder parameters. The cache is keyed by a
+/// hash of exactly those, so a rerun of the same scene maps the finished
+/// `nodes` and `primIndices` arrays instead of building.
+#pragma once
+
+#include "bvh3.hpp"
+#include "hittable.hpp"
+#include "rtweekend.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace blikker_pt3 {
+
+struct BVHCacheHeader {
+    static constexpr char expectedMagic[8] = { 'R', 'T', 'B', 'V',
+                                               'H', '\0', '\0', '\0' };
+    static constexpr uint32_t currentVersion = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeSize; ///< sizeof(BVH::Node) when written
+    uint64_t key;      ///< geometryHash() of the primitives
+    uint64_t primCount;
+    uint64_t nodeCount;
+    uint64_t nodeOffset;
+    uint64_t primIndexOffset;
+};
+
+/// @brief Hash of everything the build depends on: primitive count,
+/// centroids and bounds, BVH::binCount, BVH::builderVersion and the node
+/// layout.
+uint64_t geometryHash(const std::vector<shared_ptr<Primitive>>& primitives);
+
+/// @brief Restore a hierarchy from `<cacheDir>/<hash>.rtbvh`, or build it and
+/// store it there for the next run.
+/// @param primitives Primitives to build over, must outlive the BVH.
+/// @param loaded Set to whether the hierarchy came from the cache, if given.
+/// A cached hierarchy with invalid nodes is built and written again.
+/// @param cacheDir Created if missing.
+BVH buildCached(
+    const std::vector<shared_ptr<Primitive>>& primitives,
+    bool* loaded                = nullptr,
+    const std::string& cacheDir = "runtime/cache");
+
+/// @brief Write a built hierarchy to a cache file.
+bool writeCache(const BVH& bvh, uint64_t key, const std::string& filename);
+
+} // namespace blikker_pt3
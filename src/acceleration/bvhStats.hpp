@@ -0,0 +1,251 @@
+/// @file bvhStats.hpp
+/// Quality and traversal statistics of a BVH, for comparing builders.
+///
+/// Works with any BVH exposing `Node` (with `aabb`, `primCount`,
+/// `firstPrimIdx`, `isLeaf()`, `left()` and `right()`), `getNodes()`,
+/// `getNodeCount()` and `getPrimIndices()`, with the root at node 0 and the
+/// primitives of every subtree contiguous in the index array. That covers
+/// blikker_basic, blikker_pt2 and blikker_pt3.
+///
+/// Metrics:
+/// - SAH cost: expected cost of a random ray hitting the root box,
+///   (Ci * sum of inner node areas + Ct * sum of leaf area * primitives) /
+///   root area.
+/// - Sibling overlap: sum of the areas of the intersection of sibling boxes,
+///   relative to the root area.
+/// - EPO (Aila et al. 2013, "On Quality Metrics of Bounding Volume
+///   Hierarchies"): the share of cost weighted primitive area inside nodes
+///   that belongs to primitives outside the node's subtree. Primitives are
+///   approximated by their bounding boxes.
+/// - Sampled traversal: node visits and primitive tests per camera ray,
+///   measured with the statistics counters (stats.hpp), so these are 0 in
+///   builds with `-Dstats=false`.
+#pragma once
+
+#include "aabb.hpp"
+#include "camera.hpp"
+#include "hittable.hpp"
+#include "rtweekend.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct BVHStats {
+    std::string name;
+    float buildMs = 0;
+
+    uint32_t primitives = 0;
+    uint32_t nodes      = 0; ///< Including unused node slots
+    uint32_t innerNodes = 0;
+    uint32_t leaves     = 0;
+    size_t nodeBytes    = 0;
+    size_t indexBytes   = 0;
+
+    float sahCost        = 0;
+    float siblingOverlap = 0;
+    float epo            = 0;
+
+    std::vector<uint32_t> leafSizes;  ///< Leaves by primitive count
+    std::vector<uint32_t> leafDepths; ///< Leaves by depth, root is depth 0
+    float averageLeafDepth = 0;
+
+    uint64_t sampledRays   = 0; ///< 0 if sampleTraversal() was not run
+    float hitRate          = 0;
+    float nodeVisitsPerRay = 0;
+    float aabbTestsPerRay  = 0;
+    float primTestsPerRay  = 0;
+};
+
+namespace bvh_stats {
+
+/// @brief Intersection of two boxes, empty (area 0) if they are disjoint.
+inline float overlapArea(const Aabb& a, const Aabb& b)
+{
+    Vec3 min = glm::max(a.min, b.min);
+    Vec3 max = glm::min(a.max, b.max);
+    if (min.x > max.x || min.y > max.y || min.z > max.z) return 0.0f;
+    return Aabb { min, max }.area();
+}
+
+/// @brief Recursive part of analyzeBVH(): tree shape and costs, and the
+/// range of (leaf ordered) primitives below each node.
+template <typename Node>
+void walk(
+    const Node* nodes,
+    uint32_t nodeIdx,
+    uint32_t depth,
+    float costInner,
+    float costPrim,
+    std::vector<uint32_t>& first,
+    std::vector<uint32_t>& last,
+    BVHStats& s)
+{
+    const Node& node = nodes[nodeIdx];
+    if (node.isLeaf()) {
+        s.leaves++;
+        if (s.leafSizes.size() <= node.primCount) {
+            s.leafSizes.resize(node.primCount + 1);
+        }
+        if (s.leafDepths.size() <= depth) s.leafDepths.resize(depth + 1);
+        s.leafSizes[node.primCount]++;
+        s.leafDepths[depth]++;
+        s.averageLeafDepth += depth;
+        s.sahCost += costPrim * node.primCount * node.aabb.area();
+        first[nodeIdx] = node.firstPrimIdx;
+        last[nodeIdx]  = node.firstPrimIdx + node.primCount;
+        return;
+    }
+    s.innerNodes++;
+    s.sahCost += costInner * node.aabb.area();
+    s.siblingOverlap +=
+        overlapArea(nodes[node.left()].aabb, nodes[node.right()].aabb);
+    walk(nodes, node.left(), depth + 1, costInner, costPrim, first, last, s);
+    walk(nodes, node.right(), depth + 1, costInner, costPrim, first, last, s);
+    first[nodeIdx] = std::min(first[node.left()], first[node.right()]);
+    last[nodeIdx]  = std::max(last[node.left()], last[node.right()]);
+}
+
+} // namespace bvh_stats
+
+/// @brief Static quality metrics of `bvh`, built over `primitives`.
+/// @param costInner Cost of visiting an inner node (Ci)
+/// @param costPrim Cost of a primitive test (Ct)
+template <typename BVHT, typename Prims>
+BVHStats analyzeBVH(
+    const BVHT& bvh,
+    const Prims& primitives,
+    float costInner = 1.0f,
+    float costPrim  = 1.0f)
+{
+    using Node                             = typename BVHT::Node;
+    const Node* nodes                      = bvh.getNodes();
+    const std::vector<uint32_t>& primOrder = bvh.getPrimIndices();
+
+    BVHStats s;
+    s.primitives = primitives.size();
+    s.nodes      = bvh.getNodeCount();
+    s.nodeBytes  = s.nodes * sizeof(Node);
+    s.indexBytes = primOrder.size() * sizeof(uint32_t);
+
+    std::vector<uint32_t> first(s.nodes), last(s.nodes);
+    bvh_stats::walk(nodes, 0, 0, costInner, costPrim, first, last, s);
+
+    float rootArea = nodes[0].aabb.area();
+    s.sahCost /= rootArea;
+    s.siblingOverlap /= rootArea;
+    s.averageLeafDepth /= s.leaves;
+
+    // EPO: query the tree with the box of every primitive, splitting the
+    // cost weighted area of each overlapped node between primitives inside
+    // and outside the node's subtree.
+    double inside = 0, outside = 0;
+    std::vector<uint32_t> stack;
+    for (uint32_t p = 0; p < primOrder.size(); p++) {
+        Aabb box;
+        primitives[primOrder[p]]->growAABB(box);
+        stack.assign(1, 0);
+        while (!stack.empty()) {
+            const uint32_t nodeIdx = stack.back();
+            const Node& node       = nodes[nodeIdx];
+            stack.pop_back();
+            float area = bvh_stats::overlapArea(box, node.aabb);
+            if (area == 0.0f) continue;
+            float cost = node.isLeaf() ? costPrim * node.primCount : costInner;
+            if (first[nodeIdx] <= p && p < last[nodeIdx]) {
+                inside += cost * area;
+            } else {
+                outside += cost * area;
+            }
+            if (!node.isLeaf()) {
+                stack.push_back(node.left());
+                stack.push_back(node.right());
+            }
+        }
+    }
+    s.epo = outside / (inside + outside);
+    return s;
+}
+
+/// @brief Trace one exact (unjittered) primary ray per `stride` x `stride`
+/// pixels of `cam` through `bvh`, counting node visits and tests per ray.
+/// The camera must be initialised, see Camera::initialize().
+template <typename BVHT>
+void sampleTraversal(
+    const BVHT& bvh, const Camera& cam, BVHStats& s, int stride = 4)
+{
+    const bool wasEnabled     = stats::enabled;
+    stats::enabled            = true;
+    const stats::Counters pre = stats::local();
+
+    uint64_t rays = 0, hits = 0;
+    HitRecord rec;
+    for (int y = 0; y < cam.img.height; y += stride) {
+        for (int x = 0; x < cam.img.width; x += stride) {
+            hits += bvh.hit(cam.getRay(x, y, true), 0.001, infinity, rec);
+            rays++;
+        }
+    }
+
+    const stats::Counters& post = stats::local();
+    stats::enabled              = wasEnabled;
+    s.sampledRays               = rays;
+    s.hitRate                   = float(hits) / rays;
+    s.nodeVisitsPerRay =
+        float(post[stats::NODE_VISITS] - pre[stats::NODE_VISITS]) / rays;
+    s.aabbTestsPerRay =
+        float(post[stats::AABB_TESTS] - pre[stats::AABB_TESTS]) / rays;
+    s.primTestsPerRay =
+        float(post.primitiveTests() - pre.primitiveTests()) / rays;
+}
+
+/// @brief Build a `BVHT` over `primitives`, then analyse it and sample its
+/// traversal with camera rays.
+template <typename BVHT, typename Prims>
+BVHStats analyzeBuilder(
+    const std::string& name, const Prims& primitives, const Camera& cam)
+{
+    auto tStart = std::chrono::steady_clock::now();
+    BVHT bvh(primitives);
+    auto elapsed = std::chrono::steady_clock::now() - tStart;
+
+    BVHStats s = analyzeBVH(bvh, primitives);
+    s.name     = name;
+    s.buildMs  = std::chrono::duration<float, std::milli>(elapsed).count();
+    sampleTraversal(bvh, cam, s);
+    return s;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const BVHStats& s)
+{
+    os << s.name << ":\n"
+       << "  build: " << s.buildMs << "ms\n"
+       << "  primitives: " << s.primitives << ", nodes: " << s.nodes
+       << " (" << s.innerNodes << " inner, " << s.leaves << " leaves)\n"
+       << "  memory: " << s.nodeBytes << " B nodes + " << s.indexBytes
+       << " B indices\n"
+       << "  SAH cost: " << s.sahCost << ", EPO: " << s.epo
+       << ", sibling overlap: " << s.siblingOverlap << "\n"
+       << "  leaf depth: avg " << s.averageLeafDepth << ", max "
+       << s.leafDepths.size() - 1 << "\n";
+    os << "  leaf sizes:";
+    for (size_t i = 1; i < s.leafSizes.size(); i++) {
+        if (s.leafSizes[i]) os << " " << i << ":" << s.leafSizes[i];
+    }
+    os << "\n  leaf depths:";
+    for (size_t i = 0; i < s.leafDepths.size(); i++) {
+        if (s.leafDepths[i]) os << " " << i << ":" << s.leafDepths[i];
+    }
+    os << "\n";
+    if (s.sampledRays > 0) {
+        os << "  per camera ray (" << s.sampledRays << " rays, "
+           << s.hitRate * 100 << "% hit): node visits " << s.nodeVisitsPerRay
+           << ", AABB tests " << s.aabbTestsPerRay << ", primitive tests "
+           << s.primTestsPerRay << "\n";
+    }
+    return os;
+}
@@ -0,0 +1,91 @@
+#include "instance.hpp"
+
+#include "stats.hpp"
+
+#include <cmath>
+
+Transform Transform::inverse() const
+{
+    Transform inv;
+    inv.linear = glm::inverse(linear);
+    inv.offset = -(inv.linear * offset);
+    return inv;
+}
+
+Transform Transform::operator*(const Transform& other) const
+{
+    Transform result;
+    result.linear = linear * other.linear;
+    result.offset = linear * other.offset + offset;
+    return result;
+}
+
+Transform Transform::translate(const Vec3& offset)
+{
+    Transform t;
+    t.offset = offset;
+    return t;
+}
+
+Transform Transform::scale(const Vec3& factors)
+{
+    Transform t;
+    for (int i = 0; i < 3; i++) t.linear[i][i] = factors[i];
+    return t;
+}
+
+Transform Transform::rotate(const Vec3& axis, float radians)
+{
+    // Rodrigues' formula, column by column: each column is a rotated basis
+    // vector.
+    float c = std::cos(radians);
+    float s = std::sin(radians);
+    Transform t;
+    for (int i = 0; i < 3; i++) {
+        Vec3 e(0.0);
+        e[i]        = 1.0f;
+        t.linear[i] = e * c + glm::cross(axis, e) * s
+                    + axis * glm::dot(axis, e) * (1.0f - c);
+    }
+    return t;
+}
+
+BLAS::BLAS(std::vector<shared_ptr<Primitive>> primitives)
+    : primitives(std::move(primitives))
+    , hierarchy(this->primitives)
+{
+    hierarchy.finalize(this->primitives);
+    for (const auto& prim : this->primitives) prim->growAABB(box);
+}
+
+Instance::Instance(shared_ptr<const BLAS> blas, const Transform& toWorld)
+    : blas(std::move(blas))
+    , toObject(toWorld.inverse())
+    , normalToWorld(glm::transpose(toObject.linear))
+{
+    // Bounds of the transformed corners of the object space bounds
+    const Aabb& b = this->blas->bounds();
+    for (int i = 0; i < 8; i++) {
+        Vec3 corner(i & 1 ? b.max.x : b.min.x,
+                    i & 2 ? b.max.y : b.min.y,
+                    i & 4 ? b.max.z : b.min.z);
+        box.grow(toWorld.point(corner));
+    }
+}
+
+bool Instance::hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const
+{
+    stats::add(stats::INSTANCE_TESTS);
+    // The object space ray is normalized again, so distances along it are
+    // scaled by the length of the transformed direction.
+    Vec3 direction = toObject.vector(r.direction);
+    float scale    = glm::length(direction);
+    Ray local(toObject.point(r.origin), direction);
+    if (!blas->bvh().hit(local, tMin * scale, tMax * scale, rec)) return false;
+
+    rec.t            = rec.t / scale;
+    rec.p            = r.at(rec.t);
+    Vec3 outward     = rec.frontFace ? rec.normal : -rec.normal;
+    rec.setFaceNormal(r, glm::normalize(normalToWorld * outward));
+    return true;
+}
@@ -0,0 +1,81 @@
+/// @file instance.hpp
+/// Two-level acceleration structure. A bottom-level BVH (BLAS) is built once
+/// over the primitives of an object, and placed any number of times as an
+/// Instance with its own affine transform. Instances are primitives, so the
+/// top-level BVH (TLAS) is a blikker_pt3::BVH over them: a scene of a
+/// thousand copies of an asset stores one BLAS plus a thousand instances,
+/// and builds a hierarchy over a thousand boxes.
+///
+/// Rays are transformed into object space when they enter an instance, and
+/// their hits back into world space.
+#pragma once
+
+#include "aabb.hpp"
+#include "bvh3.hpp"
+#include "hittable.hpp"
+#include "rtweekend.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/// @brief Affine transform, `linear * p + offset`.
+struct Transform {
+    glm::mat3 linear = glm::mat3(1.0f);
+    Vec3 offset      = Vec3(0.0);
+
+    Vec3 point(const Vec3& p) const { return linear * p + offset; }
+    Vec3 vector(const Vec3& v) const { return linear * v; }
+    Transform inverse() const;
+    /// @brief This transform applied after `other`.
+    Transform operator*(const Transform& other) const;
+
+    static Transform translate(const Vec3& offset);
+    static Transform scale(const Vec3& factors);
+    static Transform scale(float factor) { return scale(Vec3(factor)); }
+    /// @param axis Unit vector
+    static Transform rotate(const Vec3& axis, float radians);
+};
+
+/// @brief Bottom-level BVH, owning the primitives it is built over.
+class BLAS {
+public:
+    /// @param primitives In object space.
+    BLAS(std::vector<shared_ptr<Primitive>> primitives);
+    BLAS(const BLAS&)            = delete;
+    BLAS& operator=(const BLAS&) = delete;
+
+    const blikker_pt3::BVH& bvh() const { return hierarchy; }
+    /// @brief Object space bounds of all primitives.
+    const Aabb& bounds() const { return box; }
+    size_t primitiveCount() const { return primitives.size(); }
+
+private:
+    // Declared before `hierarchy`, which refers to it.
+    std::vector<shared_ptr<Primitive>> primitives;
+    blikker_pt3::BVH hierarchy;
+    Aabb box;
+};
+
+/// @brief A BLAS placed in the world.
+class Instance : public Primitive {
+public:
+    /// @param toWorld Object to world transform, must be invertible.
+    Instance(shared_ptr<const BLAS> blas, const Transform& toWorld);
+
+    // Hittable
+    bool
+    hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const override;
+
+    // Primitive
+    Vec3 centroid() const override { return 0.5f * (box.min + box.max); }
+    void growAABB(Aabb& aabb) const override { aabb.grow(box); }
+
+private:
+    shared_ptr<const BLAS> blas;
+    Transform toObject;
+    /// @brief Inverse transpose of the linear part of the object to world
+    /// transform, which keeps normals perpendicular to the surface.
+    glm::mat3 normalToWorld;
+    Aabb box; ///< World space bounds
+};
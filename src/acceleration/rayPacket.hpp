@@ -0,0 +1,113 @@
+/// @file rayPacket.hpp
+/// Packet of coherent rays traversed together through an acceleration
+/// structure, sharing one traversal stack.
+///
+/// Ray data is kept both as Ray objects, for primitive tests, and as arrays
+/// (structure of arrays) so the per-node slab test over all rays of the packet
+/// vectorises. When all rays share their origin, the packet also carries the
+/// bounding frustum of its rays, used to reject whole subtrees with a single
+/// test.
+#pragma once
+
+#include "aabb.hpp"
+#include "ray.hpp"
+#include "rtweekend.hpp"
+
+#include <glm/glm.hpp>
+
+struct RayPacket {
+    /// @brief Rays per packet, a 4x4 pixel block.
+    static constexpr int size = 16;
+
+    /// @brief Bounding frustum of the rays, four planes through the shared
+    /// origin with normals pointing inwards.
+    struct Frustum {
+        Vec3 origin;
+        Vec3 normals[4];
+        bool valid = false;
+
+        /// @brief Set up from the four corner directions of the frustum, in
+        /// order around its edge.
+        void set(const Vec3& o, const Vec3 corners[4])
+        {
+            origin      = o;
+            Vec3 center = corners[0] + corners[1] + corners[2] + corners[3];
+            for (int i = 0; i < 4; i++) {
+                normals[i] = glm::cross(corners[i], corners[(i + 1) % 4]);
+                if (glm::dot(normals[i], center) < 0) normals[i] = -normals[i];
+            }
+            valid = true;
+        }
+
+        /// @brief True if the box lies completely outside one of the planes,
+        /// in which case no ray of the packet can hit it.
+        bool rejects(const Aabb& box) const
+        {
+            for (int i = 0; i < 4; i++) {
+                const Vec3& n = normals[i];
+                // Corner of the box furthest along the plane normal
+                Vec3 p(
+                    n.x >= 0 ? box.max.x : box.min.x,
+                    n.y >= 0 ? box.max.y : box.min.y,
+                    n.z >= 0 ? box.max.z : box.min.z);
+                if (glm::dot(n, p - origin) < 0) return true;
+            }
+            return false;
+        }
+    };
+
+    Ray rays[size];
+    int count = 0; ///< Number of valid rays, the rest are padding
+
+    // Structure of arrays copy of the rays, for vectorised slab tests.
+    alignas(64) float ox[size];
+    alignas(64) float oy[size];
+    alignas(64) float oz[size];
+    alignas(64) float rdx[size]; ///< Reciprocal direction
+    alignas(64) float rdy[size];
+    alignas(64) float rdz[size];
+
+    Frustum frustum;
+
+    /// @brief Fill the arrays from `rays[0..count)`. Padding rays get a zero
+    /// origin and direction, and never report a hit since traversal gives
+    /// them an empty interval.
+    void finalize()
+    {
+        for (int i = 0; i < size; i++) {
+            const Ray& r = rays[i < count ? i : 0];
+            ox[i]        = r.origin.x;
+            oy[i]        = r.origin.y;
+            oz[i]        = r.origin.z;
+            rdx[i]       = 1.0f / r.direction.x;
+            rdy[i]       = 1.0f / r.direction.y;
+            rdz[i]       = 1.0f / r.direction.z;
+        }
+    }
+
+    /// @brief Slab test of all rays against `box`, writing a per-ray hit
+    /// mask. Rays only hit if the box entry is closer than their `tMax`.
+    /// @return True if any ray hits.
+    bool hit(const Aabb& box, float tMin, const float* tMax, bool* mask) const
+    {
+        bool any = false;
+#pragma omp simd reduction(| : any)
+        for (int i = 0; i < size; i++) {
+            float tx1  = (box.min.x - ox[i]) * rdx[i];
+            float tx2  = (box.max.x - ox[i]) * rdx[i];
+            float tmin = std::min(tx1, tx2);
+            float tmax = std::max(tx1, tx2);
+            float ty1  = (box.min.y - oy[i]) * rdy[i];
+            float ty2  = (box.max.y - oy[i]) * rdy[i];
+            tmin       = std::max(tmin, std::min(ty1, ty2));
+            tmax       = std::min(tmax, std::max(ty1, ty2));
+            float tz1  = (box.min.z - oz[i]) * rdz[i];
+            float tz2  = (box.max.z - oz[i]) * rdz[i];
+            tmin       = std::max(tmin, std::min(tz1, tz2));
+            tmax       = std::min(tmax, std::max(tz1, tz2));
+            mask[i]    = tmax >= tmin && tmax > tMin && tmin < tMax[i];
+            any |= mask[i];
+        }
+        return any;
+    }
+};
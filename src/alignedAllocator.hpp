@@ -0,0 +1,57 @@
+/// @file alignedAllocator.hpp
+/// Allocator for arrays that are traversed by cache lines, such as BVH nodes:
+/// the array starts on a cache line, so records that are laid out in pairs
+/// of 32 bytes share a line. Arrays of at least a huge page can also be
+/// backed by transparent huge pages, saving TLB misses on large scenes.
+#pragma once
+
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+/// @brief Ask for transparent huge pages for large AlignedAllocator arrays.
+/// Off by default, as the kernel may then reserve up to a huge page more
+/// than is used.
+inline bool hugePages = false;
+
+template <typename T, size_t Alignment = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    static constexpr size_t HUGE_PAGE_BYTES = size_t(2) << 20;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&)
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        size_t bytes     = n * sizeof(T);
+        size_t alignment = hugePages && bytes >= HUGE_PAGE_BYTES
+                             ? HUGE_PAGE_BYTES
+                             : Alignment;
+        // aligned_alloc() takes a multiple of the alignment
+        bytes   = (bytes + alignment - 1) / alignment * alignment;
+        void* p = std::aligned_alloc(alignment, bytes);
+        if (!p) throw std::bad_alloc();
+        if (alignment == HUGE_PAGE_BYTES) madvise(p, bytes, MADV_HUGEPAGE);
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t) { std::free(p); }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const
+    {
+        return true;
+    }
+};
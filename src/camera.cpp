@@ -1,49 +1,168 @@
 #include "camera.hpp"
 #include "image.hpp"
 #include "material.hpp"
+#include "perfCounters.hpp"
 #include "ray.hpp"
+#include "trace.hpp"
+#include "wavefront.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 
 void Camera::render(const Hittable& world)
 {
+    trace::Zone zone("render", "render");
     initialize();
-    float sampleCoefficient = 1.0 / static_cast<float>(samplesPerPixel);
-    // Tiling can greatly improve render time, but will be scene dependent and
-    // completely irrelevant for BVH structures. Tesing uniti.tri
-    // (samples=16,depth=8, width=400) on Arm remote machine, tile size:
-    // - 1: 4272ms
-    // - 4: 751ms
-    // - 8: 354ms
-    // - 16: 333ms
-    int tileSize             = 16;
-    for (int j = 0; j < img.height; j += tileSize) {
-        for (int i = 0; i < img.width; i += tileSize) {
-            for (int jt = 0; jt < tileSize && j + jt < img.height; jt++) {
-                for (int it = 0; it < tileSize && i + it < img.width; it++) {
-                    Color pxColor(0.0);
-                    int x = i + it;
-                    int y = j + jt;
-                    for (int s = 0; s < samplesPerPixel; s++) {
-                        auto u = (x + randomFloat()) / (img.width - 1);
-                        auto v = (y + randomFloat()) / (img.height - 1);
-                        auto r = getRay(x, y);
-                        pxColor += rayColor(r, world, maxDepth);
-                        // if (j % 40 == 0 && i % 20 == 0 && !s)
-                        //     std::cerr << "(" << i << "," << j << ")" << r <<
-                        //     " :
-                        //     "
-                        //               << pxColor << std::endl;
-                    }
-                    img.setPixel(x, y, pxColor * sampleCoefficient);
-                }
+    auto tStart = std::chrono::steady_clock::now();
+    if (integrator == Integrator::WAVEFRONT) {
+        WavefrontIntegrator(*this, world).render();
+    } else {
+        // Tiling can greatly improve render time, but will be scene dependent
+        // and completely irrelevant for BVH structures. Tesing uniti.tri
+        // (samples=16,depth=8, width=400) on Arm remote machine, tile size:
+        // - 1: 4272ms
+        // - 4: 751ms
+        // - 8: 354ms
+        // - 16: 333ms
+        forEachTile(16, [&](int x0, int y0, int x1, int y1) {
+            if (primaryPackets) {
+                renderTilePackets(world, x0, y0, x1, y1);
+            } else {
+                renderTile(world, x0, y0, x1, y1);
             }
+        });
+    }
+    auto elapsed = std::chrono::steady_clock::now() - tStart;
+    stats::add(
+        stats::RENDER_NS,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+    if (heatmaps) renderHeatmaps(world);
+}
+
+/// @brief False colour for `t` in [0, 1]: blue, cyan, green, yellow, red.
+static Color heatColor(float t)
+{
+    static const Color ramp[] = {
+        Color(0.0, 0.0, 1.0),
+        Color(0.0, 1.0, 1.0),
+        Color(0.0, 1.0, 0.0),
+        Color(1.0, 1.0, 0.0),
+        Color(1.0, 0.0, 0.0),
+    };
+    float x = std::clamp(t, 0.0f, 1.0f) * 4.0f;
+    int i   = std::min(static_cast<int>(x), 3);
+    return glm::mix(ramp[i], ramp[i + 1], x - i);
+}
+
+/// @brief Write `values` into `image` scaled by their maximum.
+template <typename T>
+static void
+writeHeatmap(PPMImage& image, const std::vector<T>& values, const char* what)
+{
+    T max = *std::max_element(values.begin(), values.end());
+    std::cerr << "Heatmap " << what << ": max " << max << "\n";
+    for (int y = 0; y < image.height; y++) {
+        for (int x = 0; x < image.width; x++) {
+            float t = max > 0 ? float(values[y * image.width + x]) / max : 0;
+            image.setPixel(x, y, heatColor(t));
         }
-        if (j % (img.height / 10) < tileSize) {
-            std::cerr << "Ray tracing progress: " << j * 10 / (img.height / 10)
+    }
+}
+
+void Camera::renderHeatmaps(const Hittable& world)
+{
+    trace::Zone zone("heatmaps", "render");
+#if !RT_STATS
+    std::cerr << "Heatmaps need statistics, build with -Dstats=true\n";
+#endif
+    const int pixels = img.width * img.height;
+    std::vector<uint32_t> nodes(pixels), prims(pixels);
+    const bool wasEnabled = stats::enabled;
+    stats::enabled        = true;
+#pragma omp parallel for schedule(dynamic)
+    for (int y = 0; y < img.height; y++) {
+        HitRecord rec;
+        for (int x = 0; x < img.width; x++) {
+            const stats::Counters pre = stats::local();
+            world.hit(getRay(x, y, true), nearZero, infinity, rec);
+            stats::Counters& post = stats::local();
+            nodes[y * img.width + x] =
+                post[stats::NODE_VISITS] - pre[stats::NODE_VISITS];
+            prims[y * img.width + x] =
+                post.primitiveTests() - pre.primitiveTests();
+            // Only this thread writes its counters: rewinding them keeps the
+            // pass out of the render's figures in logIntersections().
+            post = pre;
+        }
+    }
+    stats::enabled = wasEnabled;
+
+    for (PPMImage* heatmap : { &nodeHeatmap, &primHeatmap, &tileHeatmap }) {
+        heatmap->resize(img.width, img.height);
+    }
+    writeHeatmap(nodeHeatmap, nodes, "node visits per ray");
+    writeHeatmap(primHeatmap, prims, "primitive tests per ray");
+    writeHeatmap(tileHeatmap, tileMs, "tile time (ms)");
+}
+
+void Camera::forEachTile(
+    int tileSize,
+    const std::function<void(int, int, int, int)>& renderTile)
+{
+    const int tilesX = (img.width + tileSize - 1) / tileSize;
+    const int tilesY = (img.height + tileSize - 1) / tileSize;
+    const int tiles  = tilesX * tilesY;
+    std::atomic_int tilesDone = 0;
+    if (heatmaps) tileMs.assign(img.width * img.height, 0.0f);
+#pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < tiles; tile++) {
+        int x0 = (tile % tilesX) * tileSize;
+        int y0 = (tile / tilesX) * tileSize;
+        int x1 = std::min(x0 + tileSize, img.width);
+        int y1 = std::min(y0 + tileSize, img.height);
+        seedRandom((uint64_t)seed << 32 | tile);
+        auto tStart = std::chrono::steady_clock::now();
+        {
+            trace::Zone zone("tile", "render", tile);
+            perf::Scope perfScope(perf::TILES);
+            renderTile(x0, y0, x1, y1);
+        }
+
+        if (heatmaps) {
+            float ms = std::chrono::duration<float, std::milli>(
+                           std::chrono::steady_clock::now() - tStart)
+                           .count();
+            for (int y = y0; y < y1; y++) {
+                std::fill_n(&tileMs[y * img.width + x0], x1 - x0, ms);
+            }
+        }
+
+        int done = ++tilesDone;
+        if (done * 10 / tiles != (done - 1) * 10 / tiles) {
+#pragma omp critical
+            std::cerr << "Ray tracing progress: " << done * 100 / tiles
                       << "%\n";
         }
     }
 }
 
+void Camera::renderTile(const Hittable& world, int x0, int y0, int x1, int y1)
+{
+    float sampleCoefficient = 1.0 / static_cast<float>(samplesPerPixel);
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            Color pxColor(0.0);
+            for (int s = 0; s < samplesPerPixel; s++) {
+                auto r = getRay(x, y);
+                pxColor += rayColor(r, world, maxDepth);
+            }
+            img.setPixel(x, y, pxColor * sampleCoefficient);
+        }
+    }
+}
+
 /// @brief Get a ray for pixel (u,v), randomly sampled within the square
 /// covered by the pixel.
 /// @param u Horizontal position
@@ -58,6 +177,33 @@ Ray Camera::getRay(float u, float v, bool exact) const
     return Ray(rOrigin, pixelSample - rOrigin);
 }
 
+void Camera::getPacket(int x0, int y0, int x1, int y1, RayPacket& packet) const
+{
+    packet.count = 0;
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            packet.rays[packet.count++] = getRay(x, y);
+        }
+    }
+    packet.finalize();
+
+    packet.frustum.valid = false;
+    if (defocusAngle <= 0) {
+        // Pixel samples stay within half a pixel of the pixel centre, so the
+        // corners of the block's pixel area bound all rays.
+        auto corner = [&](float x, float y) {
+            return pixel00Loc + (x * uPixelDelta) + (y * vPixelDelta) - origin;
+        };
+        Vec3 corners[4] = {
+            corner(x0 - 0.5f, y0 - 0.5f),
+            corner(x1 - 0.5f, y0 - 0.5f),
+            corner(x1 - 0.5f, y1 - 0.5f),
+            corner(x0 - 0.5f, y1 - 0.5f),
+        };
+        packet.frustum.set(origin, corners);
+    }
+}
+
 void Camera::initialize()
 {
     imageHeight = static_cast<int>(imageWidth / aspectRatio);
@@ -140,10 +286,19 @@ Color Camera::rayColor(const Ray& ray, const Hittable& world, int depth)
     HitRecord rec;
     // Depth limit exceeded, no more light is gathered
     if (depth <= 0) return Color(0.0);
+    stats::add(stats::RAYS);
     // Return background colour if we hit nothing
     if (!world.hit(ray, nearZero, infinity, rec))
         return background; // bgRayColor(ray);
+    return shade(ray, rec, world, depth);
+}
 
+Color Camera::shade(
+    const Ray& ray,
+    const HitRecord& rec,
+    const Hittable& world,
+    int depth)
+{
     Ray scattered;
     Color attenuance;
     Color emissionColor = rec.mat->emitted(rec);
@@ -154,3 +309,43 @@ Color Camera::rayColor(const Ray& ray, const Hittable& world, int depth)
     Color scatterColor = attenuance * rayColor(scattered, world, depth - 1);
     return scatterColor + emissionColor;
 }
+
+void Camera::renderTilePackets(
+    const Hittable& world,
+    int x0,
+    int y0,
+    int x1,
+    int y1)
+{
+    const int blockSize     = 4; // 4x4 pixels fill a RayPacket
+    float sampleCoefficient = 1.0 / static_cast<float>(samplesPerPixel);
+    RayPacket packet;
+    HitRecord recs[RayPacket::size];
+    bool hits[RayPacket::size];
+    Color pxColor[RayPacket::size];
+
+    for (int by = y0; by < y1; by += blockSize) {
+        for (int bx = x0; bx < x1; bx += blockSize) {
+            int bx1 = std::min(bx + blockSize, x1);
+            int by1 = std::min(by + blockSize, y1);
+            for (auto& c : pxColor) c = Color(0.0);
+            for (int s = 0; s < samplesPerPixel && maxDepth > 0; s++) {
+                getPacket(bx, by, bx1, by1, packet);
+                stats::add(stats::RAYS, packet.count);
+                world.hitPacket(packet, nearZero, recs, hits);
+                for (int i = 0; i < packet.count; i++) {
+                    const Ray& r = packet.rays[i];
+                    pxColor[i] += hits[i] ? shade(r, recs[i], world, maxDepth)
+                                          : background;
+                }
+            }
+            // Rays are generated row by row over the block
+            int i = 0;
+            for (int y = by; y < by1; y++) {
+                for (int x = bx; x < bx1; x++, i++) {
+                    img.setPixel(x, y, pxColor[i] * sampleCoefficient);
+                }
+            }
+        }
+    }
+}
@@ -9,15 +9,29 @@
 #include "ray.hpp"
 #include "rtweekend.hpp"
 
+#include <functional>
 #include <ostream>
+#include <vector>
 
 class Camera {
 public:
+    /// @brief How paths are traced: one at a time by recursing rayColor(), or
+    /// a bounce at a time for a whole tile by WavefrontIntegrator.
+    enum class Integrator { MEGAKERNEL, WAVEFRONT };
+
     PPMImage img;
     // Quality and Performance - - -
-    int samplesPerPixel = 10;
-    int maxDepth        = 10;
-    int imageWidth      = 100;
+    int samplesPerPixel   = 10;
+    int maxDepth          = 10;
+    int imageWidth        = 100;
+    Integrator integrator = Integrator::MEGAKERNEL;
+    /// @brief Trace primary rays as packets of 4x4 pixels (one sample each)
+    /// through Hittable::hitPacket(), instead of one by one. Only used by the
+    /// megakernel integrator.
+    bool primaryPackets   = false;
+    /// @brief Sort secondary rays by origin and direction before tracing them.
+    /// Only used by the wavefront integrator.
+    bool reorderRays      = false;
 
     // Image settings - - -
     float aspectRatio = 1.0;
@@ -35,6 +49,18 @@ public:
     /// @brief Distance from camera lookFrom point to plane of perfect focus
     float focusDist    = 10.0;
 
+    /// @brief Seed of the random sequences, which restart for every tile.
+    uint32_t seed = 0;
+
+    // Debugging - - -
+    /// @brief Also render false colour heatmaps of the BVH node visits and
+    /// primitive tests of each pixel's primary ray, and of the wall clock time
+    /// of each tile. Blue is cheap, red is the most expensive in the image.
+    bool heatmaps = false;
+    PPMImage nodeHeatmap;
+    PPMImage primHeatmap;
+    PPMImage tileHeatmap;
+
     void render(const Hittable& world);
     /// @brief Get a ray for pixel (u,v), randomly sampled within the square
     /// covered by the pixel.
@@ -43,9 +69,22 @@ public:
     /// @param exact Set true to return exact direction instead of sampling
     /// within pixel square
     Ray getRay(float u, float v, bool exact = false) const;
+    /// @brief Call `renderTile(x0, y0, x1, y1)` for every tile of the image,
+    /// in parallel. The random sequence is seeded per tile from `seed` and the
+    /// tile index, so the image does not depend on the thread count.
+    void forEachTile(
+        int tileSize,
+        const std::function<void(int, int, int, int)>& renderTile);
+    /// @brief Fill a packet with one sampled ray per pixel of the block
+    /// [x0, x1) x [y0, y1), at most 4x4 pixels. Without defocus, all rays share
+    /// the camera origin and the packet frustum is set to bound the block.
+    void getPacket(int x0, int y0, int x1, int y1, RayPacket& packet) const;
 
-private:
+    /// @brief Set up the image and viewport from the settings above. Called by
+    /// render(), and needed before calling getRay() directly.
     void initialize();
+
+private:
     /// @brief Returns a random point in the square surrounding a pixel at the
     /// origin.
     Vec3 pixelSampleSquare() const;
@@ -53,6 +92,24 @@ private:
     Vec3 defocusDiskSample() const;
 
     Color rayColor(const Ray& ray, const Hittable& world, int depth = 10);
+    /// @brief Colour gathered at the hit `rec` of `ray`, continuing the path
+    /// with rayColor() if the material scatters.
+    Color shade(
+        const Ray& ray,
+        const HitRecord& rec,
+        const Hittable& world,
+        int depth);
+    /// @brief Fill the heatmaps, tracing one exact primary ray per pixel.
+    void renderHeatmaps(const Hittable& world);
+    /// @brief Render one tile, tracing paths one by one.
+    void renderTile(const Hittable& world, int x0, int y0, int x1, int y1);
+    /// @brief Render one tile, tracing primary rays in packets.
+    void renderTilePackets(
+        const Hittable& world,
+        int x0,
+        int y0,
+        int x1,
+        int y1);
 
     Vec3 viewportLowerLeft;
     /// @brief Image height (in pixels?)
@@ -64,4 +121,7 @@ private:
     Vec3 u, v, w;       ///< Camera frame basis vectors
     Vec3 defocusDisk_u; ///< Defocus disk horizontal basis vector
     Vec3 defocusDisk_v; ///< Defocus disk vertical basis vector
+
+    /// @brief Per pixel, time spent rendering its tile (heatmaps only).
+    std::vector<float> tileMs;
 };
@@ -0,0 +1,269 @@
+#include "generators.hpp"
+
+#include "acceleration/instance.hpp"
+#include "material.hpp"
+#include "shape/sphere.hpp"
+#include "shape/triangle.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+/// @brief Side of the cube the objects are placed in.
+const float WORLD_SIZE = 10.0;
+/// @brief Clusters of GeneratorSettings::density, and their radius.
+const int CLUSTER_COUNT     = 16;
+const float CLUSTER_RADIUS  = 0.05 * WORLD_SIZE;
+const int TERRAIN_OCTAVES   = 6;
+const float TERRAIN_HEIGHT  = 0.15 * WORLD_SIZE;
+
+/// @brief Places objects evenly in the world cube, or in clusters.
+class Placement {
+public:
+    Placement(const GeneratorSettings& settings, size_t objects)
+        : density(settings.density)
+    {
+        for (Vec3& c : clusters) {
+            c = randomVec3(-0.5f, 0.5f) * (WORLD_SIZE - 2 * CLUSTER_RADIUS);
+        }
+        // Mean distance between objects spread evenly
+        spacing = WORLD_SIZE / std::cbrt(static_cast<float>(objects));
+        size    = settings.overlap * spacing;
+    }
+
+    Vec3 next() const
+    {
+        if (randomFloat() < density) {
+            return clusters[randomInt(0, CLUSTER_COUNT)]
+                 + randomInUnitSphere() * CLUSTER_RADIUS;
+        }
+        return randomVec3(-0.5f, 0.5f) * WORLD_SIZE;
+    }
+
+    float spacing;
+    float size; ///< Object size
+    float density;
+    Vec3 clusters[CLUSTER_COUNT];
+};
+
+std::vector<shared_ptr<Material>> palette()
+{
+    return {
+        make_shared<Lambertian>(Color(0.8, 0.8, 0.8)),
+        make_shared<Lambertian>(Color(0.8, 0.3, 0.2)),
+        make_shared<Lambertian>(Color(0.2, 0.5, 0.8)),
+        make_shared<Metal>(Color(0.9, 0.8, 0.5), 0.3),
+    };
+}
+
+void soup(const GeneratorSettings& settings, Scene& scene)
+{
+    auto materials = palette();
+    Placement placement(settings, settings.count);
+    auto& prims = scene.primitives;
+    prims.reserve(settings.count);
+    for (size_t i = 0; i < settings.count; i++) {
+        Vec3 v0 = placement.next();
+        prims.push_back(make_shared<Triangle>(
+            v0,
+            v0 + randomVec3(-1.0f, 1.0f) * placement.size,
+            v0 + randomVec3(-1.0f, 1.0f) * placement.size,
+            materials[randomInt(0, materials.size())]));
+    }
+}
+
+void spheres(const GeneratorSettings& settings, Scene& scene)
+{
+    auto materials = palette();
+    Placement placement(settings, settings.count);
+    auto& prims = scene.primitives;
+    prims.reserve(settings.count);
+    for (size_t i = 0; i < settings.count; i++) {
+        prims.push_back(make_shared<Sphere>(
+            placement.next(),
+            0.5f * placement.size,
+            materials[randomInt(0, materials.size())]));
+    }
+}
+
+/// @brief A grid of n x n cells over the world's ground, two triangles each,
+/// with heights from a sum of random waves.
+void terrain(const GeneratorSettings& settings, Scene& scene)
+{
+    auto mat = make_shared<Lambertian>(Color(0.5, 0.6, 0.4));
+    size_t n
+        = std::max<size_t>(1, std::lround(std::sqrt(settings.count / 2.0)));
+
+    struct Wave {
+        Vec2 frequency;
+        float phase;
+        float amplitude;
+    } waves[TERRAIN_OCTAVES];
+    for (int o = 0; o < TERRAIN_OCTAVES; o++) {
+        float f = (1 << o) * 2 * pi / WORLD_SIZE;
+        float a = randomFloat(0.0f, 2 * pi);
+        waves[o] = { Vec2(std::cos(a) * f, std::sin(a) * f),
+                     randomFloat(0.0f, 2 * pi),
+                     TERRAIN_HEIGHT / (1 << o) };
+    }
+    auto point = [&](size_t i, size_t j) {
+        float x = (float(i) / n - 0.5f) * WORLD_SIZE;
+        float z = (float(j) / n - 0.5f) * WORLD_SIZE;
+        float y = 0;
+        for (const Wave& w : waves) {
+            y += w.amplitude
+               * std::sin(w.frequency.x * x + w.frequency.y * z + w.phase);
+        }
+        return Vec3(x, y, z);
+    };
+
+    std::vector<Vec3> row(n + 1), nextRow(n + 1);
+    for (size_t i = 0; i <= n; i++) row[i] = point(i, 0);
+    auto& prims = scene.primitives;
+    prims.reserve(2 * n * n);
+    for (size_t j = 0; j < n; j++) {
+        for (size_t i = 0; i <= n; i++) nextRow[i] = point(i, j + 1);
+        for (size_t i = 0; i < n; i++) {
+            prims.push_back(
+                make_shared<Triangle>(row[i], row[i + 1], nextRow[i + 1], mat));
+            prims.push_back(
+                make_shared<Triangle>(row[i], nextRow[i + 1], nextRow[i], mat));
+        }
+        std::swap(row, nextRow);
+    }
+}
+
+/// @brief Vertices of the 20 faces of an icosahedron of radius 1.
+std::vector<Vec3> icosahedron()
+{
+    const float t   = (1.0f + std::sqrt(5.0f)) / 2.0f;
+    const Vec3 v[]  = {
+        Vec3(-1, t, 0),  Vec3(1, t, 0),  Vec3(-1, -t, 0), Vec3(1, -t, 0),
+        Vec3(0, -1, t),  Vec3(0, 1, t),  Vec3(0, -1, -t), Vec3(0, 1, -t),
+        Vec3(t, 0, -1),  Vec3(t, 0, 1),  Vec3(-t, 0, -1), Vec3(-t, 0, 1),
+    };
+    const int faces[20][3] = {
+        { 0, 11, 5 }, { 0, 5, 1 },  { 0, 1, 7 },   { 0, 7, 10 }, { 0, 10, 11 },
+        { 1, 5, 9 },  { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+        { 3, 9, 4 },  { 3, 4, 2 },  { 3, 2, 6 },   { 3, 6, 8 },  { 3, 8, 9 },
+        { 4, 9, 5 },  { 2, 4, 11 }, { 6, 2, 10 },  { 8, 6, 7 },  { 9, 8, 1 },
+    };
+    std::vector<Vec3> vertices;
+    for (const auto& face : faces) {
+        for (int k : face) vertices.push_back(glm::normalize(v[k]));
+    }
+    return vertices;
+}
+
+/// @brief Clouds of icosahedra: flattened into triangles, or as instances of
+/// one BLAS per material.
+void cloud(const GeneratorSettings& settings, Scene& scene)
+{
+    auto materials   = palette();
+    auto object      = icosahedron();
+    size_t perObject = object.size() / 3;
+    size_t objects   = std::max<size_t>(1, settings.count / perObject);
+
+    std::vector<shared_ptr<const BLAS>> blases;
+    if (settings.instanced) {
+        for (const auto& mat : materials) {
+            std::vector<shared_ptr<Primitive>> tris;
+            for (size_t k = 0; k < object.size(); k += 3) {
+                tris.push_back(make_shared<Triangle>(
+                    object[k], object[k + 1], object[k + 2], mat));
+            }
+            blases.push_back(make_shared<BLAS>(std::move(tris)));
+        }
+    }
+
+    Placement placement(settings, objects);
+    auto& prims = scene.primitives;
+    prims.reserve(settings.instanced ? objects : objects * perObject);
+    for (size_t i = 0; i < objects; i++) {
+        Vec3 center       = placement.next();
+        Vec3 axis         = randomUnitVector();
+        float angle       = randomFloat(0.0f, 2 * pi);
+        float radius      = 0.5f * placement.size * randomFloat(0.5f, 1.0f);
+        size_t m          = randomInt(0, materials.size());
+        Transform toWorld = Transform::translate(center)
+                          * Transform::rotate(axis, angle)
+                          * Transform::scale(radius);
+        if (settings.instanced) {
+            prims.push_back(make_shared<Instance>(blases[m], toWorld));
+            continue;
+        }
+        for (size_t k = 0; k < object.size(); k += 3) {
+            prims.push_back(make_shared<Triangle>(
+                toWorld.point(object[k]),
+                toWorld.point(object[k + 1]),
+                toWorld.point(object[k + 2]),
+                materials[m]));
+        }
+    }
+}
+
+} // namespace
+
+bool parseGenerator(const std::string& name, Generator& kind)
+{
+    for (Generator g : { Generator::SOUP,
+                         Generator::SPHERES,
+                         Generator::TERRAIN,
+                         Generator::CLOUD }) {
+        if (name == generatorName(g)) {
+            kind = g;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* generatorName(Generator kind)
+{
+    switch (kind) {
+    case Generator::SOUP: return "soup";
+    case Generator::SPHERES: return "spheres";
+    case Generator::TERRAIN: return "terrain";
+    case Generator::CLOUD: return "cloud";
+    }
+    return "";
+}
+
+void buildGenerated(const GeneratorSettings& settings, Scene& scene)
+{
+    scene.name = std::string(generatorName(settings.kind)) + "-"
+               + (settings.instanced ? "instanced-" : "")
+               + std::to_string(settings.count);
+
+    Camera& cam         = scene.cam;
+    cam.imageWidth      = 400;
+    cam.aspectRatio     = 16.0 / 9.0;
+    cam.vfov            = 50;
+    cam.samplesPerPixel = 16;
+    cam.maxDepth        = 8;
+    cam.lookAt          = Vec3(0.0);
+    cam.lookFrom        = Vec3(0.9, 0.6, 1.2) * WORLD_SIZE;
+    cam.vup             = Vec3(0.0, 1.0, 0.0);
+    cam.defocusAngle    = 0.0;
+    cam.background      = Color(0.7, 0.8, 1.0);
+
+    {
+        trace::Phase phase("generate", "build");
+        seedRandom(settings.seed);
+        switch (settings.kind) {
+        case Generator::SOUP: soup(settings, scene); break;
+        case Generator::SPHERES: spheres(settings, scene); break;
+        case Generator::TERRAIN: terrain(settings, scene); break;
+        case Generator::CLOUD: cloud(settings, scene); break;
+        }
+        std::cerr << "Generated " << scene.primitives.size()
+                  << " primitives in " << phase.elapsedNs() / 1e6 << "ms\n";
+    }
+
+    scene.cacheBVH = false;
+    scene.buildBVH();
+}
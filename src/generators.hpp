@@ -0,0 +1,45 @@
+/// @file generators.hpp
+/// Seeded procedural scenes of any size, for measuring how BVH builds and
+/// traversal scale with the primitive count. The same settings always give
+/// the same scene.
+#pragma once
+
+#include "scene.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class Generator {
+    SOUP,    ///< Random triangles
+    SPHERES, ///< Random spheres
+    TERRAIN, ///< Height field over a subdivided grid
+    CLOUD,   ///< Rotated and scaled copies of an icosahedron, see `instanced`
+};
+
+struct GeneratorSettings {
+    Generator kind = Generator::SOUP;
+    /// @brief Primitives to generate. Terrains round it to a square grid, and
+    /// clouds to whole objects.
+    size_t count  = 100000;
+    uint32_t seed = 0;
+    /// @brief Object size over the mean distance between objects, so about
+    /// how many objects overlap each point. Not used by terrains.
+    float overlap = 1.0;
+    /// @brief Fraction of the objects placed in dense clusters, the others are
+    /// spread evenly. Not used by terrains.
+    float density = 0.0;
+    /// @brief Place CLOUD objects as instances of a shared BLAS (see
+    /// acceleration/instance.hpp) instead of copying their triangles. The
+    /// scene's primitives are then the instances.
+    bool instanced = false;
+};
+
+/// @return False if `name` is not soup, spheres, terrain or cloud.
+bool parseGenerator(const std::string& name, Generator& kind);
+const char* generatorName(Generator kind);
+
+/// @brief Generate the primitives of `settings` in a cube of 10 units around
+/// the origin, set up a camera looking at it under a sky, and build the
+/// accelerator. The BVH is not cached, so its build time is always measured.
+void buildGenerated(const GeneratorSettings& settings, Scene& scene);
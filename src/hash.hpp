@@ -0,0 +1,24 @@
+/// @file hash.hpp
+/// Hashing of cache keys.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// @brief 64-bit FNV-1a, fed incrementally.
+struct Fnv1a {
+    uint64_t h = 14695981039346656037ull;
+    void add(const void* p, size_t n)
+    {
+        auto bytes = static_cast<const uint8_t*>(p);
+        for (size_t i = 0; i < n; i++) {
+            h ^= bytes[i];
+            h *= 1099511628211ull;
+        }
+    }
+    template <typename T>
+    void add(const T& value)
+    {
+        add(&value, sizeof(T));
+    }
+};
@@ -3,6 +3,7 @@
 #include "ray.hpp"
 #include "rtweekend.hpp"
 #include "acceleration/aabb.hpp"
+#include "acceleration/rayPacket.hpp"
 
 /// Forward declaration for backwards reference
 class Material;
@@ -46,6 +47,22 @@ public:
     /// @return True if there is an intersection.
     virtual bool
     hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const = 0;
+
+    /// @brief Compute the closest intersections of a packet of rays. The
+    /// default traces them one by one, acceleration structures override it to
+    /// traverse the packet as a whole.
+    /// @param recs Hit record per ray of the packet.
+    /// @param hits Set true per ray of the packet that has an intersection.
+    virtual void hitPacket(
+        const RayPacket& packet,
+        float tMin,
+        HitRecord* recs,
+        bool* hits) const
+    {
+        for (int i = 0; i < packet.count; i++) {
+            hits[i] = hit(packet.rays[i], tMin, infinity, recs[i]);
+        }
+    }
 };
 
 struct Aabb;
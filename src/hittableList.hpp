@@ -21,7 +21,8 @@ public:
     std::vector<shared_ptr<Hittable>> objects;
 };
 
-bool HittableList::hit(const Ray& ray, float tMin, float tMax, HitRecord& rec) const
+inline bool
+HittableList::hit(const Ray& ray, float tMin, float tMax, HitRecord& rec) const
 {
     HitRecord tempRec;
     bool anyHit  = false;
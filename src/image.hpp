@@ -76,6 +76,23 @@ public:
         }
     }
 
+    /// @brief Write 8-bit RGB PNG, rows in the same order as writeImage().
+    /// @return False if the file could not be written.
+    bool writePng(const std::string& filename) const {
+        std::vector<uint8_t> rgb;
+        rgb.reserve(width * height * 3);
+        for (int j = height - 1; j >= 0; --j) {
+            for (int i = 0; i < width; ++i) {
+                int px = image[j * width + i];
+                rgb.push_back((px >> 24) & 0xff);
+                rgb.push_back((px >> 16) & 0xff);
+                rgb.push_back((px >> 8) & 0xff);
+            }
+        }
+        return stbi_write_png(
+            filename.c_str(), width, height, 3, rgb.data(), width * 3);
+    }
+
 public:
     int width;
     int height;
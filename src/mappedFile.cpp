@@ -0,0 +1,69 @@
+#include "mappedFile.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : mData(std::exchange(other.mData, nullptr))
+    , mSize(std::exchange(other.mSize, 0))
+{ }
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other) {
+        close();
+        mData = std::exchange(other.mData, nullptr);
+        mSize = std::exchange(other.mSize, 0);
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+    close();
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open file: " << filename << " ("
+                  << std::strerror(errno) << ")\n";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        std::cerr << "Failed to stat file or file empty: " << filename << "\n";
+        ::close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the descriptor is closed.
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        std::cerr << "Failed to map file: " << filename << " ("
+                  << std::strerror(errno) << ")\n";
+        return false;
+    }
+    mData = static_cast<const uint8_t*>(p);
+    mSize = st.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mData) munmap(const_cast<uint8_t*>(mData), mSize);
+    mData = nullptr;
+    mSize = 0;
+}
+
+void writeSection(std::ostream& os, uint64_t offset, const void* p, size_t n)
+{
+    static const char zeros[cacheSectionAlignment] = {};
+    uint64_t pos                                   = os.tellp();
+    os.write(zeros, offset - pos);
+    os.write(static_cast<const char*>(p), n);
+}
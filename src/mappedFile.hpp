@@ -0,0 +1,55 @@
+/// @file mappedFile.hpp
+/// Read-only memory mapping of a file, used to access binary caches in place.
+/// Pages are shared through the page cache, so multiple processes mapping the
+/// same file do not duplicate its memory.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+class MappedFile {
+public:
+    MappedFile() { }
+    MappedFile(const std::string& filename) { open(filename); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    /// @brief Map the whole file read-only.
+    /// @return True on success. On failure, the reason is written to stderr.
+    bool open(const std::string& filename);
+    void close();
+
+    bool isOpen() const { return mData != nullptr; }
+    const uint8_t* data() const { return mData; }
+    size_t size() const { return mSize; }
+
+    /// @brief Typed pointer to `offset` bytes into the mapping. Offsets are
+    /// expected to be suitably aligned by the writer.
+    template <typename T>
+    const T* at(size_t offset) const
+    {
+        return reinterpret_cast<const T*>(mData + offset);
+    }
+
+private:
+    const uint8_t* mData = nullptr;
+    size_t mSize         = 0;
+};
+
+/// @brief Alignment of the sections of binary cache files.
+const uint64_t cacheSectionAlignment = 64;
+
+/// @brief Round `offset` up to the next section boundary.
+inline uint64_t alignSection(uint64_t offset)
+{
+    return (offset + cacheSectionAlignment - 1) & ~(cacheSectionAlignment - 1);
+}
+
+/// @brief Zero pad `os` up to `offset`, then write `n` bytes from `p`.
+void writeSection(std::ostream& os, uint64_t offset, const void* p, size_t n);
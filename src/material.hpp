@@ -14,6 +14,17 @@
 // Or we could have an abstract material class that encapsulates behavior.
 // -> might give cleaner code
 
+/// @brief Concrete material kinds, used to group hits by material when
+/// shading in batches.
+enum class MaterialType {
+    LAMBERTIAN,
+    METAL,
+    DIELECTRIC,
+    TWO_SIDED,
+    DIFFUSE_LIGHT,
+    OTHER,
+};
+
 class Material {
 public:
     virtual bool scatter(
@@ -24,6 +35,7 @@ public:
     virtual Color emitted(const HitRecord& rec) const { return Color(0.0); }
     virtual ~Material() = default;
     virtual std::string name() const { return "Unnamed Material"; };
+    virtual MaterialType type() const { return MaterialType::OTHER; }
 };
 
 // ----------------------------------------------------------------------------/
@@ -33,6 +45,7 @@ public:
     Lambertian(const Color& a) : albedo(make_shared<SolidColorTexture>(a)) { }
     Lambertian(shared_ptr<Texture> a) : albedo(a) { }
     std::string name() const override { return "Lambertian"; }
+    MaterialType type() const override { return MaterialType::LAMBERTIAN; }
 
     /// @brief Calculate scatter ray according to material properties
     /// @param vIn Incoming ray
@@ -60,6 +73,7 @@ public:
     { }
     Metal(const Color& a) : Metal(make_shared<SolidColorTexture>(a)) { }
     std::string name() const override { return "Metal"; }
+    MaterialType type() const override { return MaterialType::METAL; }
 
     /// @brief Calculate scatter ray according to material properties
     /// @param vIn Incoming ray
@@ -95,6 +109,7 @@ public:
         , materialBack(mBack)
     { }
     std::string name() const override { return "TwoSided"; }
+    MaterialType type() const override { return MaterialType::TWO_SIDED; }
 
     /// @brief Calculate scatter ray according to material properties
     /// @param vIn Incoming ray
@@ -118,6 +133,7 @@ class Dielectric : public Material {
 public:
     Dielectric(float refractionIndex) : ir(refractionIndex) { }
     std::string name() const override { return "Dielectric"; }
+    MaterialType type() const override { return MaterialType::DIELECTRIC; }
 
     virtual bool scatter(
         const Vec3& vIn,
@@ -143,6 +159,7 @@ class DiffuseLight : public Material {
 public:
     DiffuseLight(shared_ptr<Texture> a) : emit(a) { }
     DiffuseLight(Color c) : emit(make_shared<SolidColorTexture>(c)) { }
+    MaterialType type() const override { return MaterialType::DIFFUSE_LIGHT; }
     /// @brief Add no reflection
     bool scatter(
         const Vec3& vIn,
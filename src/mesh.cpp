@@ -0,0 +1,540 @@
+#include "mesh.hpp"
+
+#include "modelTri.hpp"
+#include "shape/meshTriangle.hpp"
+#include "shape/triangle.hpp"
+#include "trace.hpp"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+/// @brief OBJ files are split into chunks of at least this size, parsed in
+/// parallel.
+const size_t OBJ_MIN_CHUNK_BYTES = 1 << 20;
+
+/// @brief Index of a vertex attribute referred to by an OBJ face corner, -1
+/// if not given. A chunk does not know how many attributes the chunks before
+/// it define, so relative (negative) indices are kept relative to the start
+/// of the chunk until the chunks are merged.
+struct ObjIndex {
+    int32_t index = -1;
+    bool relative = false;
+};
+
+struct ObjCorner {
+    ObjIndex v, vt, vn;
+};
+
+/// @brief Part of an OBJ file parsed by one thread: the vertex attributes it
+/// defines and the triangles of its faces.
+struct ObjChunk {
+    std::vector<Vec3> positions;
+    std::vector<Vec2> uvs;
+    std::vector<Vec3> normals;
+    std::vector<ObjCorner> corners; ///< 3 per triangle
+    /// @brief Per triangle, index into `groupNames`, or -1 before the first
+    /// `usemtl` of the chunk.
+    std::vector<int32_t> groups;
+    std::vector<std::string> groupNames;
+    std::string error; ///< Empty if the chunk is valid
+};
+
+const char* skipSpace(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+bool parseFloat(const char*& p, const char* end, float& value)
+{
+    p                 = skipSpace(p, end);
+    auto [next, code] = std::from_chars(p, end, value);
+    p                 = next;
+    return code == std::errc();
+}
+
+/// @param count Attributes of this kind defined so far in the chunk.
+bool parseIndex(const char*& p, const char* end, size_t count, ObjIndex& index)
+{
+    int32_t i;
+    auto [next, code] = std::from_chars(p, end, i);
+    p                 = next;
+    if (code != std::errc() || i == 0) return false;
+    index.relative = i < 0;
+    index.index    = i < 0 ? static_cast<int32_t>(count) + i : i - 1;
+    return true;
+}
+
+/// @brief Parse a face corner, `v`, `v/vt`, `v//vn` or `v/vt/vn`.
+bool parseCorner(
+    const char*& p,
+    const char* end,
+    const ObjChunk& chunk,
+    ObjCorner& corner)
+{
+    if (!parseIndex(p, end, chunk.positions.size(), corner.v)) return false;
+    if (p == end || *p != '/') return true;
+    p++;
+    if (p < end && *p != '/') {
+        if (!parseIndex(p, end, chunk.uvs.size(), corner.vt)) return false;
+    }
+    if (p == end || *p != '/') return true;
+    p++;
+    return parseIndex(p, end, chunk.normals.size(), corner.vn);
+}
+
+/// @brief Parse the whole lines in [p, end) of an OBJ file. Only vertex
+/// attributes, faces and `usemtl` are read, other statements are skipped.
+void parseObjChunk(const char* p, const char* end, ObjChunk& chunk)
+{
+    int32_t group = -1;
+    std::vector<ObjCorner> face;
+    while (p < end) {
+        auto lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!lineEnd) lineEnd = end;
+        const char* e = lineEnd;
+        if (e > p && e[-1] == '\r') e--;
+        const char* line = p = skipSpace(p, e);
+        while (p < e && *p != ' ' && *p != '\t') p++;
+        std::string_view keyword(line, p - line);
+
+        bool ok = true;
+        if (keyword == "v") {
+            Vec3 v;
+            ok = parseFloat(p, e, v.x) && parseFloat(p, e, v.y)
+              && parseFloat(p, e, v.z);
+            chunk.positions.push_back(v);
+        } else if (keyword == "vt") {
+            Vec2 uv;
+            ok = parseFloat(p, e, uv.x) && parseFloat(p, e, uv.y);
+            chunk.uvs.push_back(uv);
+        } else if (keyword == "vn") {
+            Vec3 n;
+            ok = parseFloat(p, e, n.x) && parseFloat(p, e, n.y)
+              && parseFloat(p, e, n.z);
+            chunk.normals.push_back(n);
+        } else if (keyword == "f") {
+            face.clear();
+            while ((p = skipSpace(p, e)) < e && ok) {
+                ObjCorner corner;
+                ok = parseCorner(p, e, chunk, corner);
+                face.push_back(corner);
+            }
+            ok = ok && face.size() >= 3;
+            // Triangle fan
+            for (size_t i = 1; ok && i + 1 < face.size(); i++) {
+                chunk.corners.push_back(face[0]);
+                chunk.corners.push_back(face[i]);
+                chunk.corners.push_back(face[i + 1]);
+                chunk.groups.push_back(group);
+            }
+        } else if (keyword == "usemtl") {
+            p = skipSpace(p, e);
+            chunk.groupNames.emplace_back(p, e);
+            group = chunk.groupNames.size() - 1;
+        }
+        if (!ok) {
+            chunk.error = "Invalid line: " + std::string(line, e);
+            return;
+        }
+        p = lineEnd + 1;
+    }
+}
+
+/// @brief Vertex of an OBJ file: indices of its position, texture coordinate
+/// and normal.
+struct ObjVertex {
+    uint32_t v, vt, vn;
+    bool operator==(const ObjVertex& o) const
+    {
+        return v == o.v && vt == o.vt && vn == o.vn;
+    }
+};
+
+struct ObjVertexHash {
+    size_t operator()(const ObjVertex& k) const
+    {
+        return (size_t)k.v * 73856093u ^ (size_t)k.vt * 19349663u
+             ^ (size_t)k.vn * 83492791u;
+    }
+};
+
+/// @brief Hash on the exact bit pattern of a vertex, for merging vertices.
+struct VertexHash {
+    size_t operator()(const Vec3& v) const
+    {
+        uint32_t b[3];
+        std::memcpy(b, &v, sizeof(b));
+        return (size_t)b[0] * 73856093u ^ (size_t)b[1] * 19349663u
+             ^ (size_t)b[2] * 83492791u;
+    }
+};
+
+} // namespace
+
+shared_ptr<Mesh>
+Mesh::fromTriangles(const std::vector<shared_ptr<Primitive>>& primitives)
+{
+    auto mesh = make_shared<Mesh>();
+    std::unordered_map<Vec3, uint32_t, VertexHash> vertexIdx;
+    mesh->ownedIndices.reserve(primitives.size() * 3);
+    for (const auto& prim : primitives) {
+        auto tri = std::dynamic_pointer_cast<Triangle>(prim);
+        if (!tri) continue;
+        for (const Vec3& v : tri->vertices) {
+            auto [it, inserted] =
+                vertexIdx.try_emplace(v, mesh->ownedVertices.size());
+            if (inserted) mesh->ownedVertices.push_back(v);
+            mesh->ownedIndices.push_back(it->second);
+        }
+    }
+    mesh->vertices     = mesh->ownedVertices.data();
+    mesh->indices      = mesh->ownedIndices.data();
+    mesh->mVertexCount = mesh->ownedVertices.size();
+    mesh->indexCount   = mesh->ownedIndices.size();
+    return mesh;
+}
+
+shared_ptr<Mesh> Mesh::loadObj(const std::string& filename)
+{
+    trace::Phase phase("mesh.obj", "io", "obj");
+    MappedFile file;
+    if (!file.open(filename)) return nullptr;
+    const char* begin = file.at<char>(0);
+    const char* end   = begin + file.size();
+
+    // Split at line ends, into a few chunks per thread for load balance
+    size_t chunkCount = std::clamp<size_t>(
+        file.size() / OBJ_MIN_CHUNK_BYTES,
+        1,
+        omp_get_max_threads() * 4);
+    std::vector<const char*> bounds = { begin };
+    for (size_t i = 1; i < chunkCount; i++) {
+        const char* p = std::max(begin + file.size() * i / chunkCount,
+                                 bounds.back());
+        p = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        bounds.push_back(p ? p + 1 : end);
+    }
+    bounds.push_back(end);
+    std::vector<ObjChunk> chunks(chunkCount);
+    {
+        trace::Phase phase("mesh.parse", "io", "parse");
+#pragma omp parallel for schedule(dynamic)
+        for (size_t i = 0; i < chunkCount; i++) {
+            parseObjChunk(bounds[i], bounds[i + 1], chunks[i]);
+        }
+    }
+
+    // Merge the attributes, and number the groups in order of first use
+    std::vector<Vec3> positions, normals;
+    std::vector<Vec2> uvs;
+    std::vector<uint32_t> triGroups;
+    std::vector<std::string> groupNames;
+    std::unordered_map<std::string, uint32_t> groupIds;
+    auto groupId = [&](const std::string& name) {
+        auto [it, inserted] = groupIds.try_emplace(name, groupNames.size());
+        if (inserted) groupNames.push_back(name);
+        return it->second;
+    };
+    // Attributes defined before each chunk
+    std::vector<size_t> vBase, vtBase, vnBase;
+    // Group of the faces before the chunk's first `usemtl`
+    std::string group;
+    int64_t groupIdx = -1;
+    for (const ObjChunk& chunk : chunks) {
+        if (!chunk.error.empty()) {
+            std::cerr << filename << ": " << chunk.error << "\n";
+            return nullptr;
+        }
+        vBase.push_back(positions.size());
+        vtBase.push_back(uvs.size());
+        vnBase.push_back(normals.size());
+        positions.insert(
+            positions.end(),
+            chunk.positions.begin(),
+            chunk.positions.end());
+        uvs.insert(uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+        normals.insert(
+            normals.end(),
+            chunk.normals.begin(),
+            chunk.normals.end());
+
+        std::vector<int64_t> ids(chunk.groupNames.size(), -1);
+        for (int32_t g : chunk.groups) {
+            int64_t& id = g >= 0 ? ids[g] : groupIdx;
+            if (id < 0) id = groupId(g >= 0 ? chunk.groupNames[g] : group);
+            triGroups.push_back(id);
+        }
+        if (!ids.empty()) {
+            group    = chunk.groupNames.back();
+            groupIdx = ids.back();
+        }
+    }
+    if (triGroups.empty()) {
+        std::cerr << filename << ": No faces\n";
+        return nullptr;
+    }
+
+    // Resolve the corner indices in parallel
+    std::vector<size_t> cornerBase = { 0 };
+    for (const ObjChunk& chunk : chunks) {
+        cornerBase.push_back(cornerBase.back() + chunk.corners.size());
+    }
+    std::vector<ObjVertex> corners(cornerBase.back());
+    bool valid = true, allUVs = true, allNormals = true;
+    auto resolve = [](const ObjIndex& i, size_t base, size_t count) {
+        int64_t index = i.relative ? base + i.index : i.index;
+        return index >= 0 && (size_t)index < count ? (uint32_t)index
+                                                   : UINT32_MAX;
+    };
+#pragma omp parallel for schedule(dynamic) \
+    reduction(&& : valid, allUVs, allNormals)
+    for (size_t c = 0; c < chunkCount; c++) {
+        const ObjChunk& chunk = chunks[c];
+        for (size_t i = 0; i < chunk.corners.size(); i++) {
+            const ObjCorner& corner = chunk.corners[i];
+            ObjVertex& vertex       = corners[cornerBase[c] + i];
+            vertex.v  = resolve(corner.v, vBase[c], positions.size());
+            vertex.vt = resolve(corner.vt, vtBase[c], uvs.size());
+            vertex.vn = resolve(corner.vn, vnBase[c], normals.size());
+            valid      = valid && vertex.v != UINT32_MAX;
+            allUVs     = allUVs && vertex.vt != UINT32_MAX;
+            allNormals = allNormals && vertex.vn != UINT32_MAX;
+        }
+    }
+    if (!valid) {
+        std::cerr << filename << ": Face refers to a missing vertex\n";
+        return nullptr;
+    }
+
+    auto mesh = make_shared<Mesh>();
+    if (!allUVs && !allNormals) {
+        // Only positions, which are indexed already
+        mesh->ownedVertices = std::move(positions);
+        mesh->ownedIndices.resize(corners.size());
+        for (size_t i = 0; i < corners.size(); i++) {
+            mesh->ownedIndices[i] = corners[i].v;
+        }
+    } else {
+        // Merge corners with the same attributes into one vertex
+        trace::Phase phase("mesh.dedup", "io", "dedup");
+        std::unordered_map<ObjVertex, uint32_t, ObjVertexHash> vertexIdx;
+        vertexIdx.reserve(positions.size());
+        mesh->ownedIndices.reserve(corners.size());
+        for (ObjVertex vertex : corners) {
+            if (!allUVs) vertex.vt = 0;
+            if (!allNormals) vertex.vn = 0;
+            auto [it, inserted] =
+                vertexIdx.try_emplace(vertex, mesh->ownedVertices.size());
+            if (inserted) {
+                mesh->ownedVertices.push_back(positions[vertex.v]);
+                if (allUVs) mesh->ownedUVs.push_back(uvs[vertex.vt]);
+                if (allNormals) {
+                    mesh->ownedNormals.push_back(normals[vertex.vn]);
+                }
+            }
+            mesh->ownedIndices.push_back(it->second);
+        }
+    }
+    mesh->vertices     = mesh->ownedVertices.data();
+    mesh->indices      = mesh->ownedIndices.data();
+    mesh->mVertexCount = mesh->ownedVertices.size();
+    mesh->indexCount   = mesh->ownedIndices.size();
+    if (allUVs) mesh->uvs = mesh->ownedUVs.data();
+    if (allNormals) mesh->normals = mesh->ownedNormals.data();
+    mesh->groupNames = groupNames;
+    if (groupNames.size() > 1) {
+        mesh->ownedGroups = std::move(triGroups);
+        mesh->groups      = mesh->ownedGroups.data();
+    }
+    std::cerr << "Loaded mesh of " << mesh->triangleCount() << " tris ("
+              << mesh->vertexCount() << " vertices, " << groupNames.size()
+              << " groups" << (allNormals ? ", normals" : "")
+              << (allUVs ? ", uvs" : "") << ") from file " << filename << "\n";
+    return mesh;
+}
+
+shared_ptr<Mesh> Mesh::load(const std::string& filename)
+{
+    auto mesh = make_shared<Mesh>();
+    if (!mesh->file.open(filename)) return nullptr;
+
+    const MappedFile& f = mesh->file;
+    if (f.size() < sizeof(MeshFileHeader)) {
+        std::cerr << "Mesh cache too small: " << filename << "\n";
+        return nullptr;
+    }
+    auto header = f.at<MeshFileHeader>(0);
+    if (std::memcmp(header->magic, MeshFileHeader::expectedMagic, 8) != 0
+        || header->version != MeshFileHeader::currentVersion) {
+        std::cerr << "Not a mesh cache of version "
+                  << MeshFileHeader::currentVersion << ": " << filename << "\n";
+        return nullptr;
+    }
+    // Counts within the 32-bit members, sections within the file
+    auto fits = [&](uint64_t offset, uint64_t bytes) {
+        return offset <= f.size() && bytes <= f.size() - offset;
+    };
+    uint64_t triCount = header->indexCount / 3;
+    bool valid        = header->vertexCount <= UINT32_MAX
+                && header->indexCount <= UINT32_MAX
+                && header->indexCount % 3 == 0;
+    auto section = [&](uint64_t offset, uint64_t bytes) {
+        if (offset && !fits(offset, bytes)) valid = false;
+    };
+    valid = valid && header->vertexOffset && header->indexOffset;
+    section(header->vertexOffset, header->vertexCount * sizeof(Vec3));
+    section(header->indexOffset, header->indexCount * sizeof(uint32_t));
+    section(header->normalOffset, header->vertexCount * sizeof(Vec3));
+    section(header->uvOffset, header->vertexCount * sizeof(Vec2));
+    section(header->groupOffset, triCount * sizeof(uint32_t));
+    section(header->groupNameOffset, header->groupNameBytes);
+    if (!valid) {
+        std::cerr << "Mesh cache truncated: " << filename << "\n";
+        return nullptr;
+    }
+
+    mesh->vertices     = f.at<Vec3>(header->vertexOffset);
+    mesh->indices      = f.at<uint32_t>(header->indexOffset);
+    mesh->mVertexCount = header->vertexCount;
+    mesh->indexCount   = header->indexCount;
+    if (header->normalOffset) {
+        mesh->normals = f.at<Vec3>(header->normalOffset);
+    }
+    if (header->uvOffset) mesh->uvs = f.at<Vec2>(header->uvOffset);
+    if (header->groupOffset) {
+        mesh->groups = f.at<uint32_t>(header->groupOffset);
+    }
+    if (header->groupNameOffset && header->groupNameBytes) {
+        const char* names = f.at<char>(header->groupNameOffset);
+        uint64_t bytes    = header->groupNameBytes;
+        if (names[bytes - 1] != '\0') valid = false;
+        mesh->groupNames.clear();
+        for (uint64_t i = 0; valid && i < bytes;) {
+            mesh->groupNames.emplace_back(names + i);
+            i += mesh->groupNames.back().size() + 1;
+        }
+    }
+    for (uint32_t i = 0; valid && i < mesh->indexCount; i++) {
+        valid = mesh->indices[i] < mesh->mVertexCount;
+    }
+    for (uint32_t i = 0; valid && mesh->groups && i < triCount; i++) {
+        valid = mesh->groups[i] < mesh->groupCount();
+    }
+    if (!valid) {
+        std::cerr << "Mesh cache corrupt: " << filename << "\n";
+        return nullptr;
+    }
+    return mesh;
+}
+
+shared_ptr<Mesh> Mesh::loadCached(const std::string& filename)
+{
+    trace::Phase phase("mesh.load", "io");
+    namespace fs = std::filesystem;
+    bool obj     = filename.ends_with(".obj");
+    if (!obj && !filename.ends_with(".tri")) {
+        std::cerr << "Unsupported mesh format: " << filename << "\n";
+        return nullptr;
+    }
+    if (!fs::exists(filename)) {
+        std::cerr << "Failed to open file: " << filename << "\n";
+        return nullptr;
+    }
+    std::string cached = filename + ".rtmesh";
+    std::error_code ec;
+    if (fs::exists(cached, ec)
+        && fs::last_write_time(cached, ec) >= fs::last_write_time(filename, ec)
+        && !ec) {
+        if (auto mesh = load(cached)) {
+            std::cerr << "Mapped mesh of " << mesh->triangleCount()
+                      << " tris from cache " << cached << "\n";
+            return mesh;
+        }
+    }
+
+    auto mesh = obj ? loadObj(filename) : fromTriangles(loadTriFile(filename));
+    if (!mesh) return nullptr;
+    if (!mesh->write(cached)) return mesh;
+    auto mapped = load(cached);
+    return mapped ? mapped : mesh;
+}
+
+bool Mesh::write(const std::string& filename) const
+{
+    MeshFileHeader header;
+    std::memcpy(header.magic, MeshFileHeader::expectedMagic, 8);
+    header.version     = MeshFileHeader::currentVersion;
+    header.reserved    = 0;
+    header.vertexCount = mVertexCount;
+    header.indexCount  = indexCount;
+
+    std::string names;
+    for (const std::string& name : groupNames) {
+        names.append(name).push_back('\0');
+    }
+    uint64_t vertexBytes  = sizeof(Vec3) * mVertexCount;
+    uint64_t indexBytes   = sizeof(uint32_t) * indexCount;
+    uint64_t normalBytes  = normals ? sizeof(Vec3) * mVertexCount : 0;
+    uint64_t uvBytes      = uvs ? sizeof(Vec2) * mVertexCount : 0;
+    uint64_t groupBytes   = groups ? sizeof(uint32_t) * triangleCount() : 0;
+    header.groupNameBytes = names.size();
+    header.vertexOffset   = alignSection(sizeof(MeshFileHeader));
+    header.indexOffset    = alignSection(header.vertexOffset + vertexBytes);
+    uint64_t offset       = alignSection(header.indexOffset + indexBytes);
+    auto place = [&](uint64_t bytes) {
+        uint64_t start = bytes ? offset : 0;
+        offset         = alignSection(offset + bytes);
+        return start;
+    };
+    header.normalOffset    = place(normalBytes);
+    header.uvOffset        = place(uvBytes);
+    header.groupOffset     = place(groupBytes);
+    header.groupNameOffset = place(names.size());
+
+    std::ofstream f(filename, std::ios::binary | std::ios::trunc);
+    if (!f.is_open()) {
+        std::cerr << "Failed to open file: " << filename << "\n";
+        return false;
+    }
+    f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeSection(f, header.vertexOffset, vertices, vertexBytes);
+    writeSection(f, header.indexOffset, indices, indexBytes);
+    if (normals) writeSection(f, header.normalOffset, normals, normalBytes);
+    if (uvs) writeSection(f, header.uvOffset, uvs, uvBytes);
+    if (groups) writeSection(f, header.groupOffset, groups, groupBytes);
+    writeSection(f, header.groupNameOffset, names.data(), names.size());
+    if (!f.good()) {
+        std::cerr << "Failed to write mesh cache: " << filename << "\n";
+        return false;
+    }
+    std::cerr << "Wrote mesh cache " << filename << " (" << mVertexCount
+              << " vertices, " << triangleCount() << " tris)\n";
+    return true;
+}
+
+std::vector<shared_ptr<Primitive>>
+Mesh::triangles(shared_ptr<Material> mat) const
+{
+    return triangles(std::vector<shared_ptr<Material>>(groupCount(), mat));
+}
+
+std::vector<shared_ptr<Primitive>> Mesh::triangles(
+    const std::vector<shared_ptr<Material>>& groupMaterials) const
+{
+    std::vector<shared_ptr<Primitive>> tris(triangleCount());
+    for (uint32_t i = 0; i < triangleCount(); i++) {
+        tris[i] = make_shared<MeshTriangle>(this, i, groupMaterials[group(i)]);
+    }
+    return tris;
+}
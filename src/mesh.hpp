@@ -0,0 +1,142 @@
+/// @file mesh.hpp
+/// Indexed triangle mesh, and its binary cache format (`.rtmesh`).
+///
+/// Vertices may carry normals and texture coordinates, and triangles a group,
+/// so parts of a mesh can be given different materials.
+///
+/// The cache is laid out so it can be memory mapped and used in place: a fixed
+/// header followed by the vertex array, the index array, the optional vertex
+/// attributes, triangle groups and group names. All sections start on a 64
+/// byte boundary. Hierarchies over the mesh are cached by the scene, see
+/// bvhCache.hpp and sceneFile.hpp.
+#pragma once
+
+#include "hittable.hpp"
+#include "mappedFile.hpp"
+#include "rtweekend.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Material;
+
+struct MeshFileHeader {
+    static constexpr char expectedMagic[8] = { 'R', 'T', 'M', 'E',
+                                               'S', 'H', '\0', '\0' };
+    static constexpr uint32_t currentVersion = 3;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    // Offsets are 0 if the mesh has no such section
+    uint64_t normalOffset;
+    uint64_t uvOffset;
+    uint64_t groupOffset;     ///< Group of each triangle
+    uint64_t groupNameOffset; ///< Group names, '\0' terminated
+    uint64_t groupNameBytes;
+};
+
+class Mesh {
+public:
+    /// @brief Build an indexed mesh from a list of triangles, merging shared
+    /// vertices. Primitives that are not triangles are skipped.
+    static shared_ptr<Mesh>
+    fromTriangles(const std::vector<shared_ptr<Primitive>>& primitives);
+
+    /// @brief Map a mesh cache file. The vertex and index arrays are used in
+    /// place, without copying. Sections must lie within the file, and
+    /// indices and groups within the vertices and group names.
+    /// @return nullptr if the file is missing or not a valid mesh cache.
+    static shared_ptr<Mesh> load(const std::string& filename);
+
+    /// @brief Parse a Wavefront OBJ file, in parallel. Corners with the same
+    /// position, texture coordinate and normal become one vertex, and faces
+    /// are split into triangle fans. Each `usemtl` name is a group; faces
+    /// before the first one are in a group named "". Normals and texture
+    /// coordinates are kept if every face corner has them.
+    /// @return nullptr if the file is missing or invalid, after printing why.
+    static shared_ptr<Mesh> loadObj(const std::string& filename);
+
+    /// @brief Load a .tri or .obj file through its mesh cache
+    /// (`<filename>.rtmesh`). The cache is (re)written if it is missing or
+    /// older than the source.
+    /// @return nullptr if the file can not be loaded.
+    static shared_ptr<Mesh> loadCached(const std::string& filename);
+
+    /// @brief Write the mesh to a cache file.
+    bool write(const std::string& filename) const;
+
+    /// @brief Create one primitive per triangle, referencing this mesh. The
+    /// mesh must outlive the returned primitives.
+    std::vector<shared_ptr<Primitive>>
+    triangles(shared_ptr<Material> mat) const;
+    /// @brief Create one primitive per triangle, with the material of its
+    /// group.
+    /// @param groupMaterials Material of each group, groupCount() of them.
+    std::vector<shared_ptr<Primitive>>
+    triangles(const std::vector<shared_ptr<Material>>& groupMaterials) const;
+
+    uint32_t triangleCount() const { return indexCount / 3; }
+    uint32_t vertexCount() const { return mVertexCount; }
+    const Vec3& vertex(uint32_t tri, int k) const
+    {
+        return vertices[indices[tri * 3 + k]];
+    }
+
+    bool hasNormals() const { return normals != nullptr; }
+    bool hasUVs() const { return uvs != nullptr; }
+    /// @brief Number of triangle groups, at least 1.
+    uint32_t groupCount() const { return groupNames.size(); }
+    uint32_t group(uint32_t tri) const { return groups ? groups[tri] : 0; }
+    const std::string& groupName(uint32_t group) const
+    {
+        return groupNames[group];
+    }
+
+    /// @brief Turn a hit on triangle `tri` set up by Triangle::intersect()
+    /// into one on the mesh surface: interpolate the texture coordinates and
+    /// the shading normal from the vertices, where the mesh has them.
+    void interpolate(uint32_t tri, HitRecord& rec) const
+    {
+        if (!normals && !uvs) return;
+        const uint32_t* i = indices + tri * 3;
+        float b1          = rec.u;
+        float b2          = rec.v;
+        float b0          = 1.0f - b1 - b2;
+        if (uvs) {
+            Vec2 uv = uvs[i[0]] * b0 + uvs[i[1]] * b1 + uvs[i[2]] * b2;
+            rec.u   = uv.x;
+            rec.v   = uv.y;
+        }
+        if (normals) {
+            // The side stays that of the geometric normal
+            Vec3 n = glm::normalize(
+                normals[i[0]] * b0 + normals[i[1]] * b1 + normals[i[2]] * b2);
+            rec.normal = rec.frontFace ? n : -n;
+        }
+    }
+
+private:
+    const Vec3* vertices     = nullptr;
+    const uint32_t* indices  = nullptr;
+    uint32_t mVertexCount    = 0;
+    uint32_t indexCount      = 0;
+    const Vec3* normals      = nullptr; ///< Per vertex, if any
+    const Vec2* uvs          = nullptr; ///< Per vertex, if any
+    const uint32_t* groups   = nullptr; ///< Per triangle, null if all in 0
+    std::vector<std::string> groupNames = { "" };
+
+    /// @brief Storage of a mesh built in memory.
+    std::vector<Vec3> ownedVertices;
+    std::vector<uint32_t> ownedIndices;
+    std::vector<Vec3> ownedNormals;
+    std::vector<Vec2> ownedUVs;
+    std::vector<uint32_t> ownedGroups;
+    /// @brief Storage of a mesh loaded from a cache file.
+    MappedFile file;
+};
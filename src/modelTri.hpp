@@ -10,7 +10,7 @@
 #include <string>
 #include <vector>
 
-std::vector<shared_ptr<Primitive>>
+inline std::vector<shared_ptr<Primitive>>
 loadTriFile(std::string filename, size_t length = 0)
 {
     // Fallback material for now. This model loading might be integrated in
@@ -0,0 +1,266 @@
+#include "options.hpp"
+
+#include "scenes.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+
+/// @brief Parse all of `text` as a number of type T.
+template <typename T>
+static bool parseNumber(const char* text, T& value)
+{
+    char* end;
+    if constexpr (std::is_floating_point_v<T>) {
+        value = static_cast<T>(std::strtod(text, &end));
+    } else {
+        // strtol would wrap a negative value into an unsigned field
+        if (std::is_unsigned_v<T> && std::strchr(text, '-')) return false;
+        value = static_cast<T>(std::strtol(text, &end, 10));
+    }
+    return end != text && *end == '\0';
+}
+
+/// @brief Parse a comma separated list of counts.
+static bool parseCounts(const std::string& text, std::vector<size_t>& counts)
+{
+    counts.clear();
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = std::min(text.find(',', start), text.size());
+        long count;
+        std::string item = text.substr(start, end - start);
+        if (!parseNumber(item.c_str(), count) || count <= 0) return false;
+        counts.push_back(count);
+        start = end + 1;
+    }
+    return true;
+}
+
+static bool parseAccelerator(const std::string& name, Scene::Accelerator& a)
+{
+    if (name == "bvh") {
+        a = Scene::Accelerator::BVH;
+    } else if (name == "bvh8") {
+        a = Scene::Accelerator::BVH8;
+    } else if (name == "bvh-sah") {
+        a = Scene::Accelerator::BVH_SAH;
+    } else if (name == "bvh-basic") {
+        a = Scene::Accelerator::BVH_BASIC;
+    } else if (name == "list") {
+        a = Scene::Accelerator::LIST;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool
+parseTraversal(const std::string& name, blikker_pt3::BVH::Traversal& t)
+{
+    if (name == "stack") {
+        t = blikker_pt3::BVH::Traversal::STACK;
+    } else if (name == "ordered") {
+        t = blikker_pt3::BVH::Traversal::ORDERED;
+    } else if (name == "stackless") {
+        t = blikker_pt3::BVH::Traversal::STACKLESS;
+    } else if (name == "short-stack") {
+        t = blikker_pt3::BVH::Traversal::SHORT_STACK;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/// @brief Parse the option `arg` taking `value`.
+/// @param value Null if `arg` is the last argument.
+/// @return False if `arg` is unknown or `value` is missing or invalid.
+static bool
+parseValue(const std::string& arg, const char* value, Options& options)
+{
+    auto present = [&] {
+        if (!value) std::cerr << "Missing value for " << arg << "\n";
+        return value != nullptr;
+    };
+    auto number = [&](auto& field) {
+        if (!present()) return false;
+        if (parseNumber(value, field) && field >= 0) return true;
+        std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+        return false;
+    };
+    auto text = [&](std::string& field) {
+        if (present()) field = value;
+        return value != nullptr;
+    };
+
+    if (arg == "--width") return number(options.width);
+    if (arg == "--spp") return number(options.samplesPerPixel);
+    if (arg == "--depth") return number(options.maxDepth);
+    if (arg == "--threads") return number(options.threads);
+    if (arg == "--seed") return number(options.seed);
+    if (arg == "--time") return number(options.timeBudget);
+    if (arg == "--runs") return number(options.benchRuns);
+    if (arg == "--frames") return number(options.frames);
+    if (arg == "--refit-threshold") return number(options.refitThreshold);
+    if (arg == "--overlap") return number(options.generator.overlap);
+    if (arg == "--density") {
+        if (!number(options.generator.density)) return false;
+        if (options.generator.density <= 1) return true;
+        std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+        return false;
+    }
+    if (arg == "-o" || arg == "--output") return text(options.output);
+    if (arg == "--csv") return text(options.csvFile);
+    if (arg == "--json") return text(options.jsonFile);
+    if (arg == "--trace") return text(options.traceFile);
+    if (arg == "--accel") {
+        if (!present()) return false;
+        if (parseAccelerator(value, options.accelerator)) return true;
+        std::cerr << "Unknown accelerator: " << value << "\n";
+        return false;
+    }
+    if (arg == "--traversal") {
+        if (!present()) return false;
+        if (parseTraversal(value, options.traversal)) return true;
+        std::cerr << "Unknown traversal: " << value << "\n";
+        return false;
+    }
+    if (arg == "--generate") {
+        if (!present()) return false;
+        options.generate = true;
+        if (parseGenerator(value, options.generator.kind)) return true;
+        std::cerr << "Unknown generator: " << value << "\n";
+        return false;
+    }
+    if (arg == "--count") {
+        if (!present()) return false;
+        if (parseCounts(value, options.counts)) return true;
+        std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+        return false;
+    }
+    if (arg == "--format") {
+        if (!text(options.format)) return false;
+        if (options.format == "ppm" || options.format == "png") return true;
+        std::cerr << "Unknown image format: " << value << "\n";
+        return false;
+    }
+    std::cerr << "Unknown option: " << arg << "\n";
+    return false;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            options.help = true;
+        } else if (arg == "--wavefront") {
+            options.integrator = Camera::Integrator::WAVEFRONT;
+        } else if (arg == "--packets") {
+            options.primaryPackets = true;
+        } else if (arg == "--reorder") {
+            options.integrator  = Camera::Integrator::WAVEFRONT;
+            options.reorderRays = true;
+        } else if (arg == "--huge-pages") {
+            options.hugePages = true;
+        } else if (arg == "--heatmap") {
+            options.heatmaps = true;
+        } else if (arg == "--instanced") {
+            options.generator.instanced = true;
+        } else if (arg == "--bench") {
+            options.bench = true;
+        } else if (arg == "--bvh-stats") {
+            options.bvhStats = true;
+        } else if (arg == "--perf") {
+            options.perf = true;
+        } else if (arg.starts_with("-")) {
+            const char* value = i + 1 < argc ? argv[++i] : nullptr;
+            if (!parseValue(arg, value, options)) return false;
+        } else if (!options.sceneSelected) {
+            // A scene number, or else the path of a scene file
+            int scene;
+            if (parseNumber(argv[i], scene)) {
+                options.scene = scene;
+            } else {
+                options.sceneFile = arg;
+            }
+            options.sceneSelected = true;
+        } else {
+            std::cerr << "Unexpected argument: " << arg << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+void printUsage(std::ostream& os, const char* program)
+{
+    os << "Usage: " << program << " [scene] [options]\n\n"
+       << "  scene             Scene number, 1 to " << N_SCENES
+       << " (default 1, all with --bench),\n"
+       << "                    or scene file, see scenes/\n\n"
+       << "Generated scenes, instead of a scene\n"
+       << "  --generate KIND   soup, spheres, terrain or cloud\n"
+       << "  --count N[,N...]  Primitives, a scene per count (default 100000)\n"
+       << "  --overlap F       Object size over spacing (default 1)\n"
+       << "  --density F       Fraction of objects in clusters (default 0)\n"
+       << "  --instanced       Clouds of instances of one shared BVH\n\n"
+       << "Render settings (default: the scene's own)\n"
+       << "  --width N         Image width, the height follows the aspect\n"
+       << "  --spp N           Samples per pixel (16 with --bench)\n"
+       << "  --depth N         Maximum path depth\n"
+       << "  --threads N       Render threads (default: all cores)\n"
+       << "  --seed N          Seed of the random sequences (default 0)\n"
+       << "  --time S          Fit the samples per pixel to render each image\n"
+       << "                    in about S seconds\n"
+       << "  --accel NAME      bvh (default), bvh8 (compressed, 8-wide),\n"
+       << "                    bvh-sah, bvh-basic or list\n"
+       << "  --traversal NAME  Of the bvh: stack (default), ordered (culling\n"
+       << "                    nodes entered beyond the closest hit), or\n"
+       << "                    stackless or short-stack, with little memory\n"
+       << "                    per ray\n"
+       << "  --wavefront       Wavefront integrator\n"
+       << "  --reorder         Wavefront integrator, sorting secondary rays\n"
+       << "  --packets         Trace primary rays in 4x4 packets\n"
+       << "  --huge-pages      Back large BVH node arrays by huge pages\n\n"
+       << "Output\n"
+       << "  -o, --output FILE Image path, .png or .ppm\n"
+       << "                    (default runtime/<scene name>.<format>)\n"
+       << "  --format FORMAT   ppm (default) or png, for the default path\n"
+       << "  --heatmap         Also write node, primitive and tile heatmaps\n\n"
+       << "Modes and reports\n"
+       << "  --bench           Render N times, report timings, no images\n"
+       << "  --runs N          Benchmark runs per scene (default 5)\n"
+       << "  --csv FILE        Also write benchmark results as CSV\n"
+       << "  --json FILE       Also write benchmark results as JSON\n"
+       << "  --frames N        Render N animated frames, refitting the BVH,\n"
+       << "                    and report per frame (no images with --bench)\n"
+       << "  --refit-threshold F  Rebuild once the BVH's SAH cost grew by F\n"
+       << "                    (default 1.5)\n"
+       << "  --bvh-stats       Compare the BVH builders on the scene\n"
+       << "  --perf            Count hardware performance counters\n"
+       << "  --trace FILE      Write a Chrome trace of the render phases\n"
+       << "  -h, --help        Show this help\n";
+}
+
+void applyOptions(const Options& options, Scene& scene)
+{
+    Camera& cam = scene.cam;
+    if (options.width > 0) cam.imageWidth = options.width;
+    if (options.samplesPerPixel > 0) {
+        cam.samplesPerPixel = options.samplesPerPixel;
+    }
+    if (options.maxDepth > 0) cam.maxDepth = options.maxDepth;
+    cam.seed           = options.seed;
+    cam.integrator     = options.integrator;
+    cam.primaryPackets = options.primaryPackets;
+    cam.reorderRays    = options.reorderRays;
+    cam.heatmaps       = options.heatmaps;
+
+    scene.output = options.output;
+    if (scene.output.empty() && options.format != "ppm") {
+        scene.output = "runtime/" + scene.name + "." + options.format;
+    }
+}
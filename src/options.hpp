@@ -0,0 +1,69 @@
+/// @file options.hpp
+/// Command line options of rt-cpu. Render settings left at 0 keep the values
+/// of the selected scene, so any configuration can be rendered or benchmarked
+/// from scripts without rebuilding.
+#pragma once
+
+#include "camera.hpp"
+#include "generators.hpp"
+#include "scene.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct Options {
+    int scene          = 1;
+    bool sceneSelected = false; ///< A scene number or file was given
+    std::string sceneFile;      ///< Scene description, instead of a number
+    /// @brief Generate scenes instead, one per count, see generators.hpp. The
+    /// seed is the --seed.
+    bool generate = false;
+    GeneratorSettings generator;
+    std::vector<size_t> counts;
+
+    // Render settings, 0 keeps the scene's own - - -
+    int width                      = 0;
+    int samplesPerPixel            = 0;
+    int maxDepth                   = 0;
+    int threads                    = 0; ///< 0 uses all cores
+    uint32_t seed                  = 0;
+    /// @brief Seconds per image, samples per pixel are fitted to it.
+    float timeBudget               = 0;
+    Scene::Accelerator accelerator = Scene::Accelerator::BVH;
+    blikker_pt3::BVH::Traversal traversal =
+        blikker_pt3::BVH::Traversal::STACK;
+    Camera::Integrator integrator  = Camera::Integrator::MEGAKERNEL;
+    bool primaryPackets            = false;
+    bool reorderRays               = false;
+    bool heatmaps                  = false;
+    bool hugePages                 = false; ///< See alignedAllocator.hpp
+
+    // Output - - -
+    std::string output;         ///< Image path, runtime/<scene>.<format>
+    std::string format = "ppm"; ///< "ppm" or "png", for the default path
+
+    // Modes and reports - - -
+    bool help     = false;
+    bool bench    = false;
+    bool bvhStats = false;
+    int benchRuns = 5;
+    /// @brief Render an animation of this many frames, refitting the BVH.
+    int frames           = 0;
+    float refitThreshold = 1.5; ///< BVH::refit() maxDegradation
+    std::string csvFile;
+    std::string jsonFile;
+    std::string traceFile;
+    bool perf = false;
+};
+
+/// @brief Parse the command line into `options`.
+/// @return False on an unknown option or invalid value, after printing why.
+bool parseOptions(int argc, char* argv[], Options& options);
+
+void printUsage(std::ostream& os, const char* program);
+
+/// @brief Apply the render and output settings to a built scene.
+void applyOptions(const Options& options, Scene& scene);
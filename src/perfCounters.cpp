@@ -0,0 +1,192 @@
+#include "perfCounters.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+namespace perf {
+
+bool enabled = false;
+
+const char* phaseName(Phase phase)
+{
+    switch (phase) {
+    case BUILD: return "build";
+    case TILES: return "tiles";
+    case TRAVERSAL: return "traversal";
+    case SHADING: return "shading";
+    default: return "unknown";
+    }
+}
+
+namespace {
+
+/// @brief Counter group of one thread, and its totals per phase.
+struct ThreadCounters {
+    int fds[EVENT_COUNT];
+    bool open = false;
+    Counts phases[PHASE_COUNT];
+
+    ThreadCounters();
+    ~ThreadCounters();
+    bool read(Counts& counts) const;
+};
+
+std::mutex registryMutex;
+std::vector<ThreadCounters*> registry;
+/// @brief Totals of threads that have exited.
+Counts retired[PHASE_COUNT];
+
+void accumulate(Counts& sum, const Counts& counts)
+{
+    for (int e = 0; e < EVENT_COUNT; e++) sum.values[e] += counts.values[e];
+}
+
+#ifdef __linux__
+int openCounter(uint64_t config, int groupFd)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP;
+    // This thread only, on any CPU
+    return syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+#endif
+
+ThreadCounters::ThreadCounters()
+{
+    std::fill_n(fds, EVENT_COUNT, -1);
+#ifdef __linux__
+    const uint64_t configs[EVENT_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    open = true;
+    for (int e = 0; e < EVENT_COUNT && open; e++) {
+        fds[e] = openCounter(configs[e], e == 0 ? -1 : fds[0]);
+        open   = fds[e] >= 0;
+    }
+#endif
+    std::lock_guard<std::mutex> lock(registryMutex);
+    static bool warned = false;
+    if (!open && enabled && !warned) {
+        std::cerr << "Hardware performance counters are not available on "
+                     "every thread, counting only the others\n";
+        warned = true;
+    }
+    registry.push_back(this);
+}
+
+ThreadCounters::~ThreadCounters()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (int p = 0; p < PHASE_COUNT; p++) accumulate(retired[p], phases[p]);
+    registry.erase(std::find(registry.begin(), registry.end(), this));
+#ifdef __linux__
+    for (int fd : fds) {
+        if (fd >= 0) close(fd);
+    }
+#endif
+}
+
+bool ThreadCounters::read(Counts& counts) const
+{
+#ifdef __linux__
+    // PERF_FORMAT_GROUP: number of events, then their values in group order
+    uint64_t buffer[1 + EVENT_COUNT];
+    if (!open || ::read(fds[0], buffer, sizeof(buffer)) != sizeof(buffer)) {
+        return false;
+    }
+    std::copy_n(buffer + 1, EVENT_COUNT, counts.values);
+    return true;
+#else
+    return false;
+#endif
+}
+
+ThreadCounters& local()
+{
+    thread_local ThreadCounters counters;
+    return counters;
+}
+
+} // namespace
+
+bool enable()
+{
+    enabled = local().open;
+    if (!enabled) {
+        std::cerr << "Hardware performance counters are not available, "
+                     "disabling them\n";
+    }
+    return enabled;
+}
+
+Scope::Scope(Phase phase)
+    : phase(phase)
+    , active(enabled && local().read(start))
+{ }
+
+Scope::~Scope()
+{
+    Counts end;
+    if (!active || !local().read(end)) return;
+    Counts& sum = local().phases[phase];
+    for (int e = 0; e < EVENT_COUNT; e++) {
+        sum.values[e] += end.values[e] - start.values[e];
+    }
+}
+
+Counts total(Phase phase)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    Counts sum = retired[phase];
+    for (const ThreadCounters* counters : registry) {
+        accumulate(sum, counters->phases[phase]);
+    }
+    return sum;
+}
+
+void reset()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        retired[p] = Counts();
+        for (ThreadCounters* counters : registry) {
+            counters->phases[p] = Counts();
+        }
+    }
+}
+
+std::string report()
+{
+    std::stringstream ss;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        Counts c = total(static_cast<Phase>(p));
+        if (c[CYCLES] == 0) continue;
+        ss << "Perf " << phaseName(static_cast<Phase>(p)) << ": "
+           << c[CYCLES] << " cycles, IPC " << c.ipc() << ", "
+           << c[CACHE_MISSES] << " cache misses, " << c[BRANCH_MISSES]
+           << " branch misses\n";
+    }
+    return ss.str();
+}
+
+} // namespace perf
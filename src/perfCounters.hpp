@@ -0,0 +1,80 @@
+/// @file perfCounters.hpp
+/// Hardware performance counters (Linux perf_event_open), per thread and per
+/// render phase.
+///
+/// Every thread that enters a perf::Scope opens its own counter group on first
+/// use, counting only that thread in user space. A scope reads the group at
+/// entry and exit and adds the difference to the thread's total for its
+/// phase, and totals of all threads are merged on read, like the statistics
+/// counters (stats.hpp). Counting is off unless switched on by enable(),
+/// which first opens the counters of the calling thread: if they cannot be
+/// opened (other systems, missing permissions, see
+/// /proc/sys/kernel/perf_event_paranoid) a warning is printed and counting
+/// stays off. Threads that fail to open theirs later are not counted.
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace perf {
+
+enum Event {
+    CYCLES,
+    INSTRUCTIONS,
+    CACHE_MISSES,
+    BRANCH_MISSES,
+    EVENT_COUNT,
+};
+
+enum Phase {
+    BUILD,     ///< BVH builds
+    TILES,     ///< Rendering tiles, all threads
+    TRAVERSAL, ///< Wavefront extension stage, part of TILES
+    SHADING,   ///< Wavefront shading stage, part of TILES
+    PHASE_COUNT,
+};
+
+const char* phaseName(Phase phase);
+
+struct Counts {
+    uint64_t values[EVENT_COUNT] = {};
+
+    uint64_t operator[](Event e) const { return values[e]; }
+    double ipc() const
+    {
+        return values[CYCLES] ? double(values[INSTRUCTIONS]) / values[CYCLES]
+                              : 0.0;
+    }
+};
+
+/// @brief Runtime switch, off by default. Only written by enable(), so it is
+/// never written while other threads read it.
+extern bool enabled;
+
+/// @brief Switch counting on, if the calling thread can open the counters.
+/// Call before any parallel region.
+/// @return False, after a warning, if the counters are not available.
+bool enable();
+
+/// @brief Counts of `phase`, summed over all threads.
+Counts total(Phase phase);
+/// @brief Zero the totals of all threads.
+void reset();
+/// @brief One line per phase with any counts, empty if nothing was counted.
+std::string report();
+
+/// @brief Scoped measurement of the calling thread, added to `phase`.
+class Scope {
+public:
+    explicit Scope(Phase phase);
+    ~Scope();
+    Scope(const Scope&)            = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    Phase phase;
+    bool active;
+    Counts start;
+};
+
+} // namespace perf
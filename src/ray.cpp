@@ -1,6 +1,7 @@
 #include "ray.hpp"
 #include "hittable.hpp"
 #include "material.hpp"
+#include "perfCounters.hpp"
 #include "rtweekend.hpp"
 
 #include <glm/glm.hpp>
@@ -9,10 +10,6 @@
 #include <sstream>
 #include <string>
 
-std::atomic_uint64_t triIntersections    = 0;
-std::atomic_uint64_t aabbIntersections   = 0;
-std::atomic_uint64_t sphereIntersections = 0;
-std::atomic_uint64_t quadIntersections   = 0;
 shared_ptr<STBImage> rayHdri;
 RayBG rayBackground   = RayBG::GRADIENT;
 Color rayBgColor      = Color(1.0, 1.0, 1.0);
@@ -28,10 +25,31 @@ std::ostream& operator<<(std::ostream& os, const Ray& ray)
 std::string logIntersections()
 {
     std::stringstream ss;
-    uint64_t tot = aabbIntersections + triIntersections;
-    ss << "Intersections : " << tot << " (AABB: " << aabbIntersections
-       << ", Tri: " << triIntersections << ", Sphere: " << sphereIntersections
-       << ", Quad: " << quadIntersections << ")";
+    std::string perfReport = perf::report();
+    if (!perfReport.empty()) perfReport.pop_back(); // Trailing newline
+    if (!RT_STATS || !stats::enabled) {
+        ss << "Intersections : statistics disabled";
+        if (!perfReport.empty()) ss << "\n" << perfReport;
+        return ss.str();
+    }
+    stats::Counters c = stats::total();
+    uint64_t tot      = c[stats::AABB_TESTS] + c.primitiveTests();
+    ss << "Intersections : " << tot << " (AABB: " << c[stats::AABB_TESTS]
+       << ", Tri: " << c[stats::TRI_TESTS]
+       << ", Sphere: " << c[stats::SPHERE_TESTS]
+       << ", Quad: " << c[stats::QUAD_TESTS] << ")";
+    if (c[stats::INSTANCE_TESTS]) {
+        ss << "\nInstances entered : " << c[stats::INSTANCE_TESTS];
+    }
+    if (c[stats::RAYS]) {
+        double rays    = c[stats::RAYS];
+        double seconds = c[stats::RENDER_NS] * 1e-9;
+        ss << "\nRays : " << c[stats::RAYS];
+        if (seconds > 0) ss << " (" << rays / seconds * 1e-6 << " Mrays/s)";
+        ss << ", node visits/ray: " << c[stats::NODE_VISITS] / rays
+           << ", primitive tests/ray: " << c.primitiveTests() / rays;
+    }
+    if (!perfReport.empty()) ss << "\n" << perfReport;
     return ss.str();
 }
 
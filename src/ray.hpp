@@ -2,10 +2,10 @@
 
 #include "image.hpp"
 #include "rtweekend.hpp"
+#include "stats.hpp"
 
 #include <glm/glm.hpp>
 
-#include <atomic>
 #include <ostream>
 #include <string>
 
@@ -48,11 +48,8 @@ extern shared_ptr<STBImage> rayHdri;
 extern Color rayBgColor;
 extern Vec3 rayBgLightSource;
 
-extern std::atomic_uint64_t triIntersections;
-extern std::atomic_uint64_t aabbIntersections;
-extern std::atomic_uint64_t sphereIntersections;
-extern std::atomic_uint64_t quadIntersections;
-
+/// @brief Summary of the statistics counters (see stats.hpp): intersection
+/// tests by kind, rays per second, node visits and primitive tests per ray.
 std::string logIntersections();
 
 class Hittable;
@@ -3,6 +3,7 @@
 #include <glm/glm.hpp>
 
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <limits>
 #include <memory>
@@ -36,13 +37,47 @@ const float nearZero = 1e-8f;
 
 inline float degreesToRadians(float degrees) { return degrees * pi / 180.0f; }
 
-inline int randomInt(int min, int max) { return min + rand() % (max - min); }
+// Random numbers
+
+/// @brief State of the calling thread's random number generator (PCG32).
+/// Every thread has its own, so sampling never contends between threads.
+inline uint64_t& randomState()
+{
+    thread_local uint64_t state = 0x853C49E6748FEA9Bull;
+    return state;
+}
+
+/// @brief Return a random 32-bit integer
+inline uint32_t randomU32()
+{
+    uint64_t& state     = randomState();
+    uint64_t old        = state;
+    state               = old * 6364136223846793005ull + 1442695040888963407ull;
+    uint32_t xorShifted = ((old >> 18u) ^ old) >> 27u;
+    uint32_t rot        = old >> 59u;
+    return (xorShifted >> rot) | (xorShifted << ((-rot) & 31));
+}
+
+/// @brief Restart the calling thread's random sequence from `seed`. Renders
+/// seed per tile, so results do not depend on which thread renders a tile.
+inline void seedRandom(uint64_t seed)
+{
+    randomState() = 0;
+    randomU32();
+    randomState() += seed;
+    randomU32();
+}
+
+inline int randomInt(int min, int max)
+{
+    return min + randomU32() % (max - min);
+}
 
 
 // `float` utilities
 
 /// @brief Return a random float in the [0, 1)
-inline float randomFloat() { return (float)rand() / ((float)RAND_MAX + 1.0f); }
+inline float randomFloat() { return (randomU32() >> 8) * (1.0f / 16777216.0f); }
 
 inline float randomFloat(float min, float max)
 {
@@ -0,0 +1,430 @@
+#include "scene.hpp"
+
+#include "acceleration/bvh1.hpp"
+#include "acceleration/bvh2.hpp"
+#include "acceleration/bvh8.hpp"
+#include "acceleration/bvhCache.hpp"
+#include "hittableList.hpp"
+#include "perfCounters.hpp"
+#include "ray.hpp"
+#include "shape/sphere.hpp"
+#include "stats.hpp"
+#include "taskTimer.hpp"
+#include "trace.hpp"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+/// @brief Finalize `bvh` over the scene's primitives, see BVH::finalize(),
+/// keeping the rest positions with their primitives.
+template <typename BVHType>
+static void finalize(BVHType& bvh, Scene& scene)
+{
+    std::vector<uint32_t> order = bvh.finalize(scene.primitives);
+    if (order.empty() || scene.restPositions.empty()) return;
+    std::vector<Vec3> rest(scene.restPositions.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        for (int k = 0; k < 3; k++) {
+            rest[3 * i + k] = scene.restPositions[3 * order[i] + k];
+        }
+    }
+    scene.restPositions = std::move(rest);
+}
+
+void Scene::buildBVH(const BVHStore* store)
+{
+    trace::Phase phase("bvh", "build");
+    if (accelerator == Accelerator::BVH_BASIC) {
+        triangles.clear();
+        for (const auto& prim : primitives) {
+            if (auto tri = std::dynamic_pointer_cast<Triangle>(prim)) {
+                triangles.push_back(tri);
+            }
+        }
+        if (triangles.size() != primitives.size()) {
+            std::cerr << "blikker_basic only takes triangles, using "
+                         "blikker_pt3\n";
+            accelerator = Accelerator::BVH;
+        }
+    }
+    bvhCached = false;
+    switch (accelerator) {
+    case Accelerator::BVH: {
+        shared_ptr<blikker_pt3::BVH> bvh;
+        if (store && store->nodeCount) {
+            bvh = make_shared<blikker_pt3::BVH>(
+                primitives,
+                store->nodes,
+                store->nodeCount,
+                store->primIndices);
+            bvhCached = bvh->isRestored();
+        } else if (store || !cacheBVH) {
+            bvh = make_shared<blikker_pt3::BVH>(primitives);
+        } else {
+            bvh = make_shared<blikker_pt3::BVH>(
+                blikker_pt3::buildCached(primitives, &bvhCached));
+        }
+        if (store && !bvhCached && store->write) store->write(*bvh);
+        finalize(*bvh, *this);
+        bvh->traversal = traversal;
+        bvhNodes       = bvh->getNodesUsed();
+        bvhBytes       = bvh->memoryBytes();
+        this->bvh      = bvh;
+        break;
+    }
+    case Accelerator::BVH8: {
+        // The binary hierarchy is only needed while collapsing
+        auto bvh = cacheBVH ? make_shared<blikker_pt3::BVH8>(
+                       primitives,
+                       blikker_pt3::buildCached(primitives, &bvhCached))
+                            : make_shared<blikker_pt3::BVH8>(primitives);
+        finalize(*bvh, *this);
+        bvhNodes  = bvh->getNodesUsed();
+        bvhBytes  = bvh->memoryBytes();
+        this->bvh = bvh;
+        break;
+    }
+    case Accelerator::BVH_SAH: {
+        auto bvh = make_shared<blikker_pt2::BVH>(primitives);
+        bvhNodes  = bvh->getNodesUsed();
+        bvhBytes  = bvh->memoryBytes();
+        this->bvh = bvh;
+        break;
+    }
+    case Accelerator::BVH_BASIC: {
+        auto bvh = make_shared<blikker_basic::BVH>(triangles);
+        bvhNodes  = bvh->getNodesUsed();
+        bvhBytes  = bvh->memoryBytes();
+        this->bvh = bvh;
+        break;
+    }
+    case Accelerator::LIST: {
+        auto list = make_shared<HittableList>();
+        for (const auto& prim : primitives) list->add(prim);
+        bvhNodes = 0;
+        bvhBytes = 0;
+        bvh      = list;
+        break;
+    }
+    }
+    assembleWorld();
+    buildMs = phase.elapsedNs() / 1e6;
+    std::cerr << (bvhCached ? "Load BVH: " : "Build BVH: ") << buildMs
+              << "ms, nodes used: " << bvhNodes << ", " << bvhBytes / 1024
+              << " KiB\n";
+}
+
+void Scene::assembleWorld()
+{
+    if (unbounded.empty()) {
+        world = bvh;
+        return;
+    }
+    auto list = make_shared<HittableList>();
+    if (bvh) list->add(bvh);
+    for (const auto& object : unbounded) list->add(object);
+    world = list;
+}
+
+void Scene::fitTimeBudget(float seconds)
+{
+    int samplesPerPixel = cam.samplesPerPixel;
+    cam.samplesPerPixel = 1;
+    auto tStart         = std::chrono::steady_clock::now();
+    cam.render(*world);
+    double pilotS = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - tStart)
+                        .count();
+    stats::reset();
+    perf::reset();
+
+    cam.samplesPerPixel = std::max(1, static_cast<int>(seconds / pilotS));
+    std::cerr << "Time budget " << seconds << "s: " << cam.samplesPerPixel
+              << " samples per pixel (scene default " << samplesPerPixel
+              << ", 1 sample takes " << pilotS * 1e3 << "ms)\n";
+}
+
+/// @brief Path `path` with `suffix` inserted before its extension.
+static std::string
+withSuffix(const std::string& path, const std::string& suffix)
+{
+    size_t dot   = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot == std::string::npos
+        || (slash != std::string::npos && dot < slash)) {
+        return path + suffix;
+    }
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+/// @brief Write `image` as PNG if `filename` ends in .png, else as PPM.
+static void writeImage(PPMImage& image, const std::string& filename)
+{
+    trace::Phase phase("image.write", "io");
+    if (filename.ends_with(".png")) {
+        if (!image.writePng(filename)) {
+            std::cerr << "Failed to write file: " << filename << "\n";
+        }
+        return;
+    }
+    std::ofstream f(filename);
+    if (!f.is_open()) {
+        std::cerr << "Failed to open file: " << filename << "\n";
+        return;
+    }
+    image.writeImage(f);
+}
+
+void Scene::render()
+{
+    for (size_t i = 0; i <= views.size(); i++) {
+        if (i > 0) cam.lookFrom = views[i - 1];
+        std::cerr << "Render " << name << " . . .\n";
+        {
+            ScopedTimer timer("render");
+            cam.render(*world);
+            std::cerr << timer.elapsedNs() / 1e6 << "ms\n";
+        }
+
+        std::cerr << logIntersections() << "\n";
+
+        std::string path = withSuffix(
+            output.empty() ? "runtime/" + name + ".ppm" : output,
+            i > 0 ? std::to_string(i) : "");
+        writeImage(cam.img, path);
+        if (cam.heatmaps) {
+            writeImage(cam.nodeHeatmap, withSuffix(path, "-nodes"));
+            writeImage(cam.primHeatmap, withSuffix(path, "-prims"));
+            writeImage(cam.tileHeatmap, withSuffix(path, "-tiles"));
+        }
+    }
+}
+
+void Scene::animate(float time)
+{
+    trace::Zone zone("animate", "build");
+    size_t count = primitives.size();
+    if (restPositions.empty()) {
+        restPositions.resize(3 * count);
+        for (size_t i = 0; i < count; i++) {
+            Primitive* prim = primitives[i].get();
+            if (auto* tri = dynamic_cast<Triangle*>(prim)) {
+                for (int k = 0; k < 3; k++) {
+                    restPositions[3 * i + k] = tri->vertices[k];
+                }
+            } else if (auto* sphere = dynamic_cast<Sphere*>(prim)) {
+                restPositions[3 * i] = sphere->center;
+            }
+        }
+    }
+
+    // A wave along the diagonal of the scene, a few waves long, moving
+    // points along the camera's up direction by up to 2% of the scene size.
+    Aabb bounds;
+    for (const auto& prim : primitives) prim->growAABB(bounds);
+    Vec3 diagonal   = bounds.max - bounds.min;
+    float size      = glm::length(diagonal);
+    Vec3 k          = diagonal * (4.0f / (size * size));
+    Vec3 up         = glm::normalize(cam.vup) * (0.02f * size);
+    auto move       = [&](const Vec3& p) {
+        return p + up * std::sin(2 * pi * (glm::dot(k, p) - time));
+    };
+    const Vec3* rest = restPositions.data();
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < count; i++) {
+        Primitive* prim = primitives[i].get();
+        if (auto* tri = dynamic_cast<Triangle*>(prim)) {
+            tri->setVertices(move(rest[3 * i]),
+                             move(rest[3 * i + 1]),
+                             move(rest[3 * i + 2]));
+        } else if (auto* sphere = dynamic_cast<Sphere*>(prim)) {
+            sphere->center = move(rest[3 * i]);
+        }
+    }
+}
+
+std::vector<FrameResult>
+Scene::renderFrames(int frames, float maxDegradation, bool writeImages)
+{
+    using Clock = std::chrono::steady_clock;
+    auto ms     = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start)
+            .count();
+    };
+    if (primitives.empty() || !bvh) {
+        std::cerr << name << ": no primitives to animate\n";
+        return {};
+    }
+    auto refittable = std::dynamic_pointer_cast<blikker_pt3::BVH>(bvh);
+    // Moved primitives never match a cached hierarchy
+    cacheBVH = false;
+
+    std::vector<FrameResult> results;
+    for (int frame = 0; frame < frames; frame++) {
+        FrameResult result;
+        result.scene = name;
+        result.frame = frame;
+        auto tStart  = Clock::now();
+        animate(float(frame) / frames);
+        result.animateMs = ms(tStart);
+
+        tStart = Clock::now();
+        if (refittable) {
+            using Action    = blikker_pt3::BVH::RefitAction;
+            Action action   = refittable->refit(maxDegradation);
+            result.updateUs = ms(tStart) * 1e3;
+            result.update   = action == Action::REFIT ? "refit"
+                            : action == Action::PARTIAL_REBUILD ? "partial"
+                                                                : "rebuild";
+            bvhNodes           = refittable->getNodesUsed();
+            result.degradation = refittable->degradation();
+        } else {
+            buildBVH();
+            result.updateUs    = ms(tStart) * 1e3;
+            result.update      = "rebuild";
+            result.degradation = 1;
+        }
+        result.bvhNodes = bvhNodes;
+
+        stats::reset();
+        perf::reset();
+        tStart = Clock::now();
+        cam.render(*world);
+        result.renderMs = ms(tStart);
+        if (writeImages) {
+            char suffix[32];
+            snprintf(suffix, sizeof(suffix), "-frame%03d", frame);
+            writeImage(cam.img,
+                       withSuffix(
+                           output.empty() ? "runtime/" + name + ".ppm" : output,
+                           suffix));
+        }
+        std::cerr << name << " frame " << frame << ": " << result.update
+                  << " " << result.updateUs << "us, render "
+                  << result.renderMs << "ms\n";
+        results.push_back(result);
+    }
+
+    double updateUs = 0;
+    for (const FrameResult& r : results) updateUs += r.updateUs;
+    if (!results.empty() && bvhNodes) {
+        updateUs /= results.size();
+        std::cerr << "BVH update: " << updateUs << "us per frame, "
+                  << updateUs * 1e3 / bvhNodes << "us per 1000 nodes\n";
+    }
+    return results;
+}
+
+BenchmarkResult benchmark(Scene& scene, int runs, int samplesPerPixel)
+{
+    if (samplesPerPixel > 0) scene.cam.samplesPerPixel = samplesPerPixel;
+
+    std::vector<double> times;
+    uint64_t rays            = 0;
+    perf::Counts buildCounts = perf::total(perf::BUILD);
+    for (int run = 0; run < runs; run++) {
+        stats::reset();
+        perf::reset();
+        auto tStart = std::chrono::steady_clock::now();
+        scene.cam.render(*scene.world);
+        times.push_back(std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - tStart)
+                            .count());
+        rays = stats::total()[stats::RAYS];
+    }
+    std::sort(times.begin(), times.end());
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    BenchmarkResult result;
+    result.scene           = scene.name;
+    result.runs            = runs;
+    result.samplesPerPixel = scene.cam.samplesPerPixel;
+    result.width           = scene.cam.img.width;
+    result.height          = scene.cam.img.height;
+    result.medianMs        = times[times.size() / 2];
+    result.minMs           = times.front();
+    result.rays            = rays;
+    result.mraysPerS       = rays / (result.medianMs * 1e3);
+    result.primitives      = scene.primitives.size();
+    result.buildMs         = scene.buildMs;
+    result.bvhCached       = scene.bvhCached;
+    result.bvhNodes        = scene.bvhNodes;
+    result.bvhKiB          = scene.bvhBytes / 1024;
+    result.peakRssKiB      = usage.ru_maxrss;
+    for (int p = 0; p < perf::PHASE_COUNT; p++) {
+        result.perf[p] = perf::total(static_cast<perf::Phase>(p));
+    }
+    result.perf[perf::BUILD] = buildCounts;
+    std::cerr << scene.name << ": " << result.medianMs << "ms median, "
+              << result.mraysPerS << " Mrays/s\n";
+    return result;
+}
+
+void writeCsv(std::ostream& os, const std::vector<BenchmarkResult>& results)
+{
+    os << "scene,runs,spp,width,height,median_ms,min_ms,rays,mrays_per_s,"
+          "primitives,build_ms,bvh_cached,bvh_nodes,bvh_kib,peak_rss_kib\n";
+    for (const BenchmarkResult& r : results) {
+        os << r.scene << "," << r.runs << "," << r.samplesPerPixel << ","
+           << r.width << "," << r.height << "," << r.medianMs << ","
+           << r.minMs << "," << r.rays << "," << r.mraysPerS << ","
+           << r.primitives << "," << r.buildMs << "," << r.bvhCached << ","
+           << r.bvhNodes << "," << r.bvhKiB << "," << r.peakRssKiB << "\n";
+    }
+}
+
+void writeJson(std::ostream& os, const std::vector<BenchmarkResult>& results)
+{
+    os << "{\n  \"scenes\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& r = results[i];
+        os << "    { \"scene\": \"" << r.scene << "\", \"runs\": " << r.runs
+           << ", \"spp\": " << r.samplesPerPixel << ", \"width\": " << r.width
+           << ", \"height\": " << r.height << ", \"median_ms\": " << r.medianMs
+           << ", \"min_ms\": " << r.minMs << ", \"rays\": " << r.rays
+           << ", \"mrays_per_s\": " << r.mraysPerS
+           << ", \"primitives\": " << r.primitives
+           << ", \"build_ms\": " << r.buildMs
+           << ", \"bvh_cached\": " << (r.bvhCached ? "true" : "false")
+           << ", \"bvh_nodes\": " << r.bvhNodes
+           << ", \"bvh_kib\": " << r.bvhKiB
+           << ", \"peak_rss_kib\": " << r.peakRssKiB;
+        if (perf::enabled) {
+            os << ", \"perf\": {";
+            for (int p = 0; p < perf::PHASE_COUNT; p++) {
+                const perf::Counts& c = r.perf[p];
+                os << (p ? ", \"" : " \"")
+                   << perf::phaseName(static_cast<perf::Phase>(p))
+                   << "\": { \"cycles\": " << c[perf::CYCLES]
+                   << ", \"instructions\": " << c[perf::INSTRUCTIONS]
+                   << ", \"ipc\": " << c.ipc()
+                   << ", \"cache_misses\": " << c[perf::CACHE_MISSES]
+                   << ", \"branch_misses\": " << c[perf::BRANCH_MISSES]
+                   << " }";
+            }
+            os << " }";
+        }
+        os << " }" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+}
+
+void writeCsv(std::ostream& os, const std::vector<FrameResult>& results)
+{
+    os << "scene,frame,animate_ms,update,update_us,update_us_per_knode,"
+          "bvh_nodes,degradation,render_ms\n";
+    for (const FrameResult& r : results) {
+        double perKNode = r.bvhNodes ? r.updateUs * 1e3 / r.bvhNodes : 0.0;
+        os << r.scene << "," << r.frame << "," << r.animateMs << ","
+           << r.update << "," << r.updateUs << "," << perKNode << ","
+           << r.bvhNodes << "," << r.degradation << "," << r.renderMs << "\n";
+    }
+}
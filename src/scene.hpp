@@ -0,0 +1,160 @@
+/// @file scene.hpp
+/// A scene is a camera set-up together with the world it looks at. Scenes are
+/// built first, then either rendered to images or benchmarked, so the same
+/// scene definitions serve both.
+#pragma once
+
+#include "acceleration/bvh3.hpp"
+#include "camera.hpp"
+#include "hittable.hpp"
+#include "mesh.hpp"
+#include "perfCounters.hpp"
+#include "rtweekend.hpp"
+#include "shape/triangle.hpp"
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// @brief Timings of one frame of Scene::renderFrames().
+struct FrameResult {
+    std::string scene;
+    int frame;
+    double animateMs;
+    double updateUs;   ///< Refit or rebuild of the accelerator
+    size_t bvhNodes;
+    /// @brief SAH cost over that of the last full build, 1 if not refitted.
+    float degradation;
+    const char* update; ///< "refit", "partial", "rebuild"
+    double renderMs;
+};
+
+/// @brief A cache of the Accelerator::BVH other than the BVH cache, such as
+/// that of scene files, for buildBVH().
+struct BVHStore {
+    /// @brief Arrays of the cached hierarchy, see the restoring
+    /// blikker_pt3::BVH constructor, or none if `nodeCount` is 0.
+    const blikker_pt3::BVH::Node* nodes = nullptr;
+    uint32_t nodeCount                  = 0;
+    const uint32_t* primIndices         = nullptr;
+    /// @brief Store a hierarchy built because there were no arrays or they
+    /// were rejected. Called before it is finalized.
+    std::function<void(const blikker_pt3::BVH&)> write;
+};
+
+struct Scene {
+    /// @brief What buildBVH() builds over `primitives`.
+    enum class Accelerator {
+        BVH,       ///< blikker_pt3, binned SAH, cached on disk
+        BVH8,      ///< blikker_pt3 collapsed into compressed 8-wide nodes
+        BVH_SAH,   ///< blikker_pt2, full SAH sweep
+        BVH_BASIC, ///< blikker_basic, midpoint splits, triangles only
+        LIST,      ///< No acceleration, every primitive is tested
+    };
+
+    Scene() = default;
+    // The BVH refers to `primitives`, so a scene stays where it was built.
+    Scene(const Scene&)            = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    /// @brief Images are written to runtime/<name>.ppm, unless `output` is
+    /// set.
+    std::string name;
+    Camera cam;
+    /// @brief Extra camera positions, rendered after the first image to
+    /// runtime/<name><i>.ppm, i = 1, 2, ...
+    std::vector<Vec3> views;
+    /// @brief Path of the first image, PNG if it ends in .png, else PPM. Other
+    /// views and heatmaps insert their suffix before the extension.
+    std::string output;
+    Accelerator accelerator = Accelerator::BVH;
+    /// @brief Load and store the Accelerator::BVH in the BVH cache. Generated
+    /// scenes are built each time, so their build is measured.
+    bool cacheBVH = true;
+    /// @brief Of the Accelerator::BVH, set before buildBVH().
+    blikker_pt3::BVH::Traversal traversal = blikker_pt3::BVH::Traversal::STACK;
+
+    /// @brief Primitives of the BVH built by buildBVH().
+    std::vector<shared_ptr<Primitive>> primitives;
+    /// @brief `primitives` for Accelerator::BVH_BASIC, which only takes
+    /// triangles.
+    std::vector<shared_ptr<Triangle>> triangles;
+    /// @brief Meshes the primitives refer to, if any.
+    std::vector<shared_ptr<Mesh>> meshes;
+    shared_ptr<Hittable> world;
+    /// @brief What buildBVH() built over `primitives`, part of `world`.
+    shared_ptr<Hittable> bvh;
+    /// @brief The rest of `world` when assembled by assembleWorld(), such as
+    /// the planes of scene files, which no BVH can bound.
+    std::vector<shared_ptr<Hittable>> unbounded;
+
+    float buildMs   = 0; ///< Time spent in buildBVH()
+    /// @brief The BVH was restored from a cache, so `buildMs` is the time to
+    /// load it rather than to build it.
+    bool bvhCached  = false;
+    size_t bvhNodes = 0; ///< Nodes used by the BVH, 0 without one
+    size_t bvhBytes = 0; ///< Of the BVH nodes and primitive indices
+    /// @brief Three per primitive: the vertices of triangles, the centre of
+    /// spheres, as they were before the first animate().
+    std::vector<Vec3> restPositions;
+
+    /// @brief Build the `accelerator` over `primitives` and use it as the
+    /// world. The default blikker_pt3::BVH is loaded from cache if possible.
+    /// blikker_pt3 hierarchies are finalized, which permutes `primitives`
+    /// (and `restPositions`) into their leaf order.
+    /// @param store Restores and stores the Accelerator::BVH instead of the
+    /// BVH cache, if given.
+    void buildBVH(const BVHStore* store = nullptr);
+    /// @brief Use `bvh`, if any, and `unbounded` as the world.
+    void assembleWorld();
+    /// @brief Set the samples per pixel so that rendering one view takes
+    /// about `seconds`, timed by a render with one sample per pixel.
+    void fitTimeBudget(float seconds);
+    /// @brief Render every view and write the images.
+    void render();
+    /// @brief Move the triangles and spheres of `primitives` by a wave
+    /// travelling through the scene, one period per unit of `time`. Vertices
+    /// move independently, so triangles deform as well.
+    void animate(float time);
+    /// @brief Render `frames` frames of animate(), updating the accelerator
+    /// before each: a blikker_pt3::BVH is refitted, see BVH::refit(), others
+    /// are rebuilt. The rest of the world stays as it is.
+    /// @return Nothing if the scene has no primitives to animate.
+    /// @param writeImages Write the first view of each frame to
+    /// runtime/<name>-frame<i>.ppm (or `output` with that suffix).
+    std::vector<FrameResult>
+    renderFrames(int frames, float maxDegradation, bool writeImages);
+};
+
+/// @brief Timings of rendering one scene several times, see benchmark().
+struct BenchmarkResult {
+    std::string scene;
+    int runs;
+    int samplesPerPixel;
+    int width;
+    int height;
+    double medianMs;
+    double minMs;
+    uint64_t rays;     ///< Per run, primary plus secondary
+    double mraysPerS;  ///< Rays over median time
+    size_t primitives; ///< Of the BVH
+    float buildMs;
+    bool bvhCached; ///< buildMs is a cache load, see Scene::bvhCached
+    size_t bvhNodes;
+    size_t bvhKiB;
+    long peakRssKiB;   ///< Of the whole process, so far
+    /// Hardware counters of the BVH build and of the last run, if enabled
+    perf::Counts perf[perf::PHASE_COUNT];
+};
+
+/// @brief Render the first view of `scene` `runs` times with
+/// `samplesPerPixel` samples (the scene's own if 0), without writing images.
+/// Rays are counted by the statistics counters, so Mrays/s is 0 if they are
+/// compiled out. Hardware counters of the build are those counted since the
+/// last benchmark() call.
+BenchmarkResult benchmark(Scene& scene, int runs, int samplesPerPixel = 0);
+
+void writeCsv(std::ostream& os, const std::vector<BenchmarkResult>& results);
+void writeJson(std::ostream& os, const std::vector<BenchmarkResult>& results);
+void writeCsv(std::ostream& os, const std::vector<FrameResult>& results);
@@ -0,0 +1,818 @@
+#include "sceneFile.hpp"
+
+#include "acceleration/bvh3.hpp"
+#include "hash.hpp"
+#include "mappedFile.hpp"
+#include "material.hpp"
+#include "mesh.hpp"
+#include "shape/plane.hpp"
+#include "shape/quad.hpp"
+#include "shape/sphere.hpp"
+#include "shape/triangle.hpp"
+#include "texture.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/// @brief The records of a scene, parsed or restored from the cache.
+struct SceneDescription {
+    uint32_t name = 0;
+    CameraRecord camera;
+    std::vector<TextureRecord> textures;
+    std::vector<MaterialRecord> materials;
+    std::vector<ShapeRecord> shapes;
+    std::vector<MeshRecord> meshes;
+    std::vector<GroupMaterialRecord> groupMaterials;
+    std::vector<Vec3> views;
+    std::string strings;
+    std::vector<DependencyRecord> dependencies;
+
+    /// @brief Append `s` to the string table.
+    /// @return Its offset.
+    uint32_t addString(const std::string& s)
+    {
+        uint32_t offset = strings.size();
+        strings.append(s).push_back('\0');
+        return offset;
+    }
+    const char* string(uint32_t offset) const
+    {
+        return strings.c_str() + offset;
+    }
+};
+
+/// @brief Record of a file as it is now, to detect changes.
+bool fileState(const std::string& path, DependencyRecord& dependency)
+{
+    std::error_code ec;
+    dependency.size  = fs::file_size(path, ec);
+    dependency.mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+    return !ec;
+}
+
+/// @brief Line by line parser of the text format into a SceneDescription.
+class Parser {
+public:
+    Parser(const std::string& filename, SceneDescription& desc)
+        : filename(filename)
+        , desc(desc)
+    { }
+
+    bool parse(std::istream& is)
+    {
+        Camera defaults;
+        desc.camera = CameraRecord {
+            defaults.imageWidth,
+            defaults.samplesPerPixel,
+            defaults.maxDepth,
+            defaults.aspectRatio,
+            defaults.vfov,
+            defaults.defocusAngle,
+            defaults.focusDist,
+            defaults.lookFrom,
+            defaults.lookAt,
+            defaults.vup,
+            defaults.background,
+        };
+        bool named = false;
+
+        std::string text;
+        while (std::getline(is, text)) {
+            line++;
+            tokens.clear();
+            next = 0;
+            std::istringstream ss(text.substr(0, text.find('#')));
+            for (std::string token; ss >> token;) tokens.push_back(token);
+            if (tokens.empty()) continue;
+
+            std::string keyword = tokens[next++];
+            bool ok;
+            if (keyword == "name") {
+                std::string name;
+                ok    = word(name, "a name") && end();
+                named = true;
+                if (ok) desc.name = desc.addString(name);
+            } else if (keyword == "camera") {
+                ok = camera();
+            } else if (keyword == "view") {
+                Vec3 view;
+                ok = vec3(view) && end();
+                desc.views.push_back(view);
+            } else if (keyword == "texture") {
+                ok = texture();
+            } else if (keyword == "material") {
+                ok = material();
+            } else if (keyword == "mesh") {
+                ok = mesh();
+            } else {
+                ok = shape(keyword);
+            }
+            if (!ok) return false;
+        }
+        if (!named) {
+            desc.name = desc.addString(fs::path(filename).stem().string());
+        }
+        return true;
+    }
+
+private:
+    const std::string filename;
+    SceneDescription& desc;
+    int line = 0;
+    std::vector<std::string> tokens; ///< Of the current line
+    size_t next = 0;                 ///< First token not parsed yet
+    std::unordered_map<std::string, uint32_t> textureNames;
+    std::unordered_map<std::string, uint32_t> materialNames;
+
+    bool error(const std::string& message) const
+    {
+        std::cerr << filename << ":" << line << ": " << message << "\n";
+        return false;
+    }
+
+    bool end() const
+    {
+        if (next == tokens.size()) return true;
+        return error("Unexpected " + tokens[next]);
+    }
+
+    bool word(std::string& value, const char* what)
+    {
+        if (next == tokens.size()) {
+            return error(std::string("Expected ") + what);
+        }
+        value = tokens[next++];
+        return true;
+    }
+
+    bool number(float& value)
+    {
+        std::string token;
+        if (!word(token, "a number")) return false;
+        char* end;
+        value = std::strtof(token.c_str(), &end);
+        // An aspect ratio may be given as a fraction
+        if (*end == '/' && end != token.c_str()) {
+            const char* denominator = end + 1;
+            value /= std::strtof(denominator, &end);
+            if (end == denominator) return error("Invalid number " + token);
+        }
+        if (end == token.c_str() || *end != '\0') {
+            return error("Invalid number " + token);
+        }
+        return true;
+    }
+
+    bool integer(int32_t& value)
+    {
+        float f;
+        if (!number(f)) return false;
+        value = static_cast<int32_t>(f);
+        if (value != f || value < 0) {
+            return error("Expected a whole number, not " + tokens[next - 1]);
+        }
+        return true;
+    }
+
+    bool vec3(Vec3& v) { return number(v.x) && number(v.y) && number(v.z); }
+
+    /// @brief Either a colour `r g b`, stored as a solid texture, or
+    /// `texture <name>`.
+    bool color(uint32_t& texture)
+    {
+        if (next < tokens.size() && tokens[next] == "texture") {
+            next++;
+            std::string name;
+            if (!word(name, "a texture name")) return false;
+            auto it = textureNames.find(name);
+            if (it == textureNames.end()) {
+                return error("Unknown texture " + name);
+            }
+            texture = it->second;
+            return true;
+        }
+        TextureRecord record {};
+        record.type = TextureRecord::SOLID;
+        if (!vec3(record.even)) return false;
+        texture = desc.textures.size();
+        desc.textures.push_back(record);
+        return true;
+    }
+
+    bool materialName(uint32_t& material)
+    {
+        std::string name;
+        if (!word(name, "a material name")) return false;
+        auto it = materialNames.find(name);
+        if (it == materialNames.end()) return error("Unknown material " + name);
+        material = it->second;
+        return true;
+    }
+
+    /// @brief `camera <setting> <value> ...`, any number of settings.
+    bool camera()
+    {
+        CameraRecord& cam = desc.camera;
+        while (next < tokens.size()) {
+            std::string key = tokens[next++];
+            bool ok;
+            if (key == "width") {
+                ok = integer(cam.imageWidth);
+            } else if (key == "aspect") {
+                ok = number(cam.aspectRatio);
+            } else if (key == "vfov") {
+                ok = number(cam.vfov);
+            } else if (key == "spp") {
+                ok = integer(cam.samplesPerPixel);
+            } else if (key == "depth") {
+                ok = integer(cam.maxDepth);
+            } else if (key == "from") {
+                ok = vec3(cam.lookFrom);
+            } else if (key == "at") {
+                ok = vec3(cam.lookAt);
+            } else if (key == "up") {
+                ok = vec3(cam.vup);
+            } else if (key == "focus") {
+                ok = number(cam.focusDist);
+            } else if (key == "defocus") {
+                ok = number(cam.defocusAngle);
+            } else if (key == "background") {
+                ok = vec3(cam.background);
+            } else {
+                return error("Unknown camera setting " + key);
+            }
+            if (!ok) return false;
+        }
+        return true;
+    }
+
+    /// @brief `texture <name> solid <r g b> | checker <scale> <r g b> <r g b>
+    /// | image <path>`
+    bool texture()
+    {
+        std::string name, type;
+        if (!word(name, "a texture name") || !word(type, "a texture type")) {
+            return false;
+        }
+        TextureRecord record {};
+        bool ok;
+        if (type == "solid") {
+            record.type = TextureRecord::SOLID;
+            ok          = vec3(record.even);
+        } else if (type == "checker") {
+            record.type = TextureRecord::CHECKER;
+            ok = number(record.scale) && vec3(record.even) && vec3(record.odd);
+        } else if (type == "image") {
+            std::string path;
+            record.type = TextureRecord::IMAGE;
+            ok          = word(path, "an image path");
+            record.path = desc.addString(path);
+        } else {
+            return error("Unknown texture type " + type);
+        }
+        if (!ok || !end()) return false;
+        textureNames[name] = desc.textures.size();
+        desc.textures.push_back(record);
+        return true;
+    }
+
+    /// @brief `material <name> lambertian <colour> | metal <colour> [fuzz <f>]
+    /// | dielectric <ior> | light <colour> | twosided <front> <back>`
+    bool material()
+    {
+        std::string name, type;
+        if (!word(name, "a material name") || !word(type, "a material type")) {
+            return false;
+        }
+        MaterialRecord record {};
+        bool ok;
+        if (type == "lambertian") {
+            record.type = MaterialRecord::LAMBERTIAN;
+            ok          = color(record.texture);
+        } else if (type == "metal") {
+            record.type = MaterialRecord::METAL;
+            ok          = color(record.texture);
+            if (ok && next < tokens.size() && tokens[next] == "fuzz") {
+                next++;
+                ok = number(record.param);
+            }
+        } else if (type == "dielectric") {
+            record.type = MaterialRecord::DIELECTRIC;
+            ok          = number(record.param);
+        } else if (type == "light") {
+            record.type = MaterialRecord::LIGHT;
+            ok          = color(record.texture);
+        } else if (type == "twosided") {
+            record.type = MaterialRecord::TWO_SIDED;
+            ok = materialName(record.front) && materialName(record.back);
+        } else {
+            return error("Unknown material type " + type);
+        }
+        if (!ok || !end()) return false;
+        materialNames[name] = desc.materials.size();
+        desc.materials.push_back(record);
+        return true;
+    }
+
+    /// @brief `sphere <centre> <radius> <material>`,
+    /// `quad <corner> <u> <v> <material>`,
+    /// `triangle <v0> <v1> <v2> <material>` or
+    /// `plane <point> <normal> <material>`
+    bool shape(const std::string& keyword)
+    {
+        ShapeRecord record {};
+        bool ok;
+        if (keyword == "sphere") {
+            record.type = ShapeRecord::SPHERE;
+            ok          = vec3(record.v[0]) && number(record.radius);
+        } else if (keyword == "quad") {
+            record.type = ShapeRecord::QUAD;
+            ok = vec3(record.v[0]) && vec3(record.v[1]) && vec3(record.v[2]);
+        } else if (keyword == "triangle") {
+            record.type = ShapeRecord::TRIANGLE;
+            ok = vec3(record.v[0]) && vec3(record.v[1]) && vec3(record.v[2]);
+        } else if (keyword == "plane") {
+            record.type = ShapeRecord::PLANE;
+            ok          = vec3(record.v[0]) && vec3(record.v[1]);
+        } else {
+            return error("Unknown statement " + keyword);
+        }
+        if (!ok || !materialName(record.material) || !end()) return false;
+        desc.shapes.push_back(record);
+        return true;
+    }
+
+    /// @brief `mesh <path> <material> [<group> <material>] ...`, a .tri or
+    /// .obj mesh, with the material of some of its groups.
+    bool mesh()
+    {
+        std::string path;
+        ShapeRecord record {};
+        record.type = ShapeRecord::MESH;
+        if (!word(path, "a mesh path") || !materialName(record.material)) {
+            return false;
+        }
+        if (!path.ends_with(".tri") && !path.ends_with(".obj")) {
+            return error("Unsupported mesh format " + path);
+        }
+        DependencyRecord dependency;
+        if (!fileState(path, dependency)) return error("No such file " + path);
+        dependency.path = desc.addString(path);
+        desc.dependencies.push_back(dependency);
+
+        MeshRecord mesh;
+        mesh.path       = dependency.path;
+        mesh.firstGroup = desc.groupMaterials.size();
+        mesh.groupCount = 0;
+        while (next < tokens.size()) {
+            GroupMaterialRecord group;
+            group.group = desc.addString(tokens[next++]);
+            if (!materialName(group.material)) return false;
+            desc.groupMaterials.push_back(group);
+            mesh.groupCount++;
+        }
+        record.mesh = desc.meshes.size();
+        desc.meshes.push_back(mesh);
+        desc.shapes.push_back(record);
+        return true;
+    }
+};
+
+/// @brief Hash of the scene file text and of everything the records and the
+/// build depend on besides it.
+uint64_t sceneHash(const std::string& text)
+{
+    Fnv1a hash;
+    hash.add(SceneCacheHeader::currentVersion);
+    hash.add(blikker_pt3::BVH::builderVersion);
+    hash.add(blikker_pt3::BVH::binCount);
+    hash.add((uint32_t)sizeof(blikker_pt3::BVH::Node));
+    hash.add(text.data(), text.size());
+    return hash.h;
+}
+
+/// @brief True if `section` of `count` elements of `T` is within the file.
+template <typename T>
+bool inFile(const SceneCacheHeader::Section& section, const MappedFile& f)
+{
+    return section.offset <= f.size()
+        && section.count <= (f.size() - section.offset) / sizeof(T);
+}
+
+/// @brief True if every index and string offset of the records is in range,
+/// so instantiate() can follow them. Materials only refer to earlier ones,
+/// as the parser defines them in order.
+bool validRecords(const SceneDescription& desc)
+{
+    const std::string& strings = desc.strings;
+    auto validString           = [&](uint64_t offset) {
+        return offset < strings.size();
+    };
+    // Every offset then ends within the table
+    if (strings.empty() || strings.back() != '\0' || !validString(desc.name)) {
+        return false;
+    }
+    for (const TextureRecord& t : desc.textures) {
+        if (t.type > TextureRecord::IMAGE) return false;
+        if (t.type == TextureRecord::IMAGE && !validString(t.path)) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < desc.materials.size(); i++) {
+        const MaterialRecord& m = desc.materials[i];
+        switch (m.type) {
+        case MaterialRecord::LAMBERTIAN:
+        case MaterialRecord::METAL:
+        case MaterialRecord::LIGHT:
+            if (m.texture >= desc.textures.size()) return false;
+            break;
+        case MaterialRecord::DIELECTRIC: break;
+        case MaterialRecord::TWO_SIDED:
+            if (m.front >= i || m.back >= i) return false;
+            break;
+        default: return false;
+        }
+    }
+    for (const ShapeRecord& shape : desc.shapes) {
+        if (shape.type > ShapeRecord::MESH
+            || shape.material >= desc.materials.size()) {
+            return false;
+        }
+        if (shape.type == ShapeRecord::MESH
+            && shape.mesh >= desc.meshes.size()) {
+            return false;
+        }
+    }
+    for (const MeshRecord& mesh : desc.meshes) {
+        if (!validString(mesh.path)
+            || mesh.firstGroup > desc.groupMaterials.size()
+            || mesh.groupCount
+                   > desc.groupMaterials.size() - mesh.firstGroup) {
+            return false;
+        }
+    }
+    for (const GroupMaterialRecord& group : desc.groupMaterials) {
+        if (!validString(group.group)
+            || group.material >= desc.materials.size()) {
+            return false;
+        }
+    }
+    for (const DependencyRecord& dependency : desc.dependencies) {
+        if (!validString(dependency.path)) return false;
+    }
+    return true;
+}
+
+template <typename T>
+std::vector<T>
+readSection(const SceneCacheHeader::Section& section, const MappedFile& f)
+{
+    const T* p = f.at<T>(section.offset);
+    return std::vector<T>(p, p + section.count);
+}
+
+/// @brief Map and validate a cache file, and restore the records from it.
+/// Returns false if it is missing, was written for another file or node
+/// layout, is damaged, or a dependency changed since.
+bool loadCache(
+    const std::string& filename,
+    uint64_t key,
+    MappedFile& f,
+    SceneDescription& desc)
+{
+    if (!fs::exists(filename) || !f.open(filename)) return false;
+    if (f.size() < sizeof(SceneCacheHeader)) return false;
+    auto header = f.at<SceneCacheHeader>(0);
+    if (std::memcmp(header->magic, SceneCacheHeader::expectedMagic, 8) != 0
+        || header->version != SceneCacheHeader::currentVersion
+        || header->nodeSize != sizeof(blikker_pt3::BVH::Node)
+        || header->key != key) {
+        std::cerr << "Ignoring stale scene cache: " << filename << "\n";
+        return false;
+    }
+    if (!inFile<TextureRecord>(header->textures, f)
+        || !inFile<MaterialRecord>(header->materials, f)
+        || !inFile<ShapeRecord>(header->shapes, f)
+        || !inFile<MeshRecord>(header->meshes, f)
+        || !inFile<GroupMaterialRecord>(header->groupMaterials, f)
+        || !inFile<Vec3>(header->views, f) || !inFile<char>(header->strings, f)
+        || !inFile<DependencyRecord>(header->dependencies, f)
+        || !inFile<blikker_pt3::BVH::Node>(header->nodes, f)
+        || !inFile<uint32_t>(header->primIndices, f)) {
+        std::cerr << "Scene cache truncated: " << filename << "\n";
+        return false;
+    }
+
+    desc.name      = std::min<uint64_t>(header->name, UINT32_MAX);
+    desc.camera    = header->camera;
+    desc.textures  = readSection<TextureRecord>(header->textures, f);
+    desc.materials = readSection<MaterialRecord>(header->materials, f);
+    desc.shapes    = readSection<ShapeRecord>(header->shapes, f);
+    desc.meshes    = readSection<MeshRecord>(header->meshes, f);
+    desc.groupMaterials =
+        readSection<GroupMaterialRecord>(header->groupMaterials, f);
+    desc.views        = readSection<Vec3>(header->views, f);
+    desc.dependencies = readSection<DependencyRecord>(header->dependencies, f);
+    desc.strings.assign(
+        f.at<char>(header->strings.offset),
+        header->strings.count);
+    if (!validRecords(desc)) {
+        std::cerr << "Ignoring damaged scene cache: " << filename << "\n";
+        return false;
+    }
+    for (const DependencyRecord& dependency : desc.dependencies) {
+        DependencyRecord now;
+        if (!fileState(desc.string(dependency.path), now)
+            || now.size != dependency.size || now.mtime != dependency.mtime) {
+            std::cerr << "Ignoring stale scene cache: "
+                      << desc.string(dependency.path) << " changed\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool writeCache(
+    const SceneDescription& desc,
+    const blikker_pt3::BVH* bvh,
+    uint64_t key,
+    const std::string& filename)
+{
+    trace::Phase phase("scene.cache.write", "io");
+    SceneCacheHeader header;
+    std::memcpy(header.magic, SceneCacheHeader::expectedMagic, 8);
+    header.version  = SceneCacheHeader::currentVersion;
+    header.nodeSize = sizeof(blikker_pt3::BVH::Node);
+    header.key      = key;
+    header.name     = desc.name;
+    header.camera   = desc.camera;
+
+    // Sections in file order
+    struct {
+        SceneCacheHeader::Section& section;
+        const void* data;
+        uint64_t count;
+        uint64_t size;
+    } sections[] = {
+        { header.textures, desc.textures.data(), desc.textures.size(),
+          sizeof(TextureRecord) },
+        { header.materials, desc.materials.data(), desc.materials.size(),
+          sizeof(MaterialRecord) },
+        { header.shapes, desc.shapes.data(), desc.shapes.size(),
+          sizeof(ShapeRecord) },
+        { header.meshes, desc.meshes.data(), desc.meshes.size(),
+          sizeof(MeshRecord) },
+        { header.groupMaterials, desc.groupMaterials.data(),
+          desc.groupMaterials.size(), sizeof(GroupMaterialRecord) },
+        { header.views, desc.views.data(), desc.views.size(), sizeof(Vec3) },
+        { header.strings, desc.strings.data(), desc.strings.size(), 1 },
+        { header.dependencies, desc.dependencies.data(),
+          desc.dependencies.size(), sizeof(DependencyRecord) },
+        { header.nodes, bvh ? bvh->getNodes() : nullptr,
+          bvh ? bvh->getNodeCount() : 0, sizeof(blikker_pt3::BVH::Node) },
+        { header.primIndices, bvh ? bvh->getPrimIndices().data() : nullptr,
+          bvh ? bvh->getPrimIndices().size() : 0, sizeof(uint32_t) },
+    };
+    uint64_t offset = sizeof(SceneCacheHeader);
+    for (auto& s : sections) {
+        s.section.offset = alignSection(offset);
+        s.section.count  = s.count;
+        offset           = s.section.offset + s.count * s.size;
+    }
+
+    // Write to a temporary name first, so concurrent runs never map a
+    // partially written cache.
+    std::string tmpFilename = filename + ".tmp";
+    std::ofstream f(tmpFilename, std::ios::binary | std::ios::trunc);
+    if (!f.is_open()) {
+        std::cerr << "Failed to open file: " << tmpFilename << "\n";
+        return false;
+    }
+    f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (auto& s : sections) {
+        writeSection(f, s.section.offset, s.data, s.count * s.size);
+    }
+    f.close();
+    std::error_code ec;
+    if (!f.good()) {
+        std::cerr << "Failed to write scene cache: " << tmpFilename << "\n";
+        fs::remove(tmpFilename, ec);
+        return false;
+    }
+    fs::rename(tmpFilename, filename, ec);
+    if (ec) {
+        std::cerr << "Failed to write scene cache: " << filename << "\n";
+        return false;
+    }
+    std::cerr << "Wrote scene cache " << filename << "\n";
+    return true;
+}
+
+/// @brief Create the camera, materials and shapes of `desc` in `scene`.
+/// Planes are returned separately, as they are not Primitives.
+/// @return False if a mesh fails to load.
+bool instantiate(
+    const SceneDescription& desc,
+    Scene& scene,
+    std::vector<shared_ptr<Hittable>>& planes)
+{
+    trace::Phase phase("scene.instantiate", "build");
+    scene.name  = desc.string(desc.name);
+    scene.views = desc.views;
+
+    const CameraRecord& c = desc.camera;
+    Camera& cam           = scene.cam;
+    cam.imageWidth        = c.imageWidth;
+    cam.samplesPerPixel   = c.samplesPerPixel;
+    cam.maxDepth          = c.maxDepth;
+    cam.aspectRatio       = c.aspectRatio;
+    cam.vfov              = c.vfov;
+    cam.defocusAngle      = c.defocusAngle;
+    cam.focusDist         = c.focusDist;
+    cam.lookFrom          = c.lookFrom;
+    cam.lookAt            = c.lookAt;
+    cam.vup               = c.vup;
+    cam.background        = c.background;
+
+    std::vector<shared_ptr<Texture>> textures;
+    for (const TextureRecord& t : desc.textures) {
+        switch (t.type) {
+        case TextureRecord::SOLID:
+            textures.push_back(make_shared<SolidColorTexture>(t.even));
+            break;
+        case TextureRecord::CHECKER:
+            textures.push_back(
+                make_shared<CheckerTexture>(t.scale, t.even, t.odd));
+            break;
+        case TextureRecord::IMAGE:
+            textures.push_back(
+                make_shared<ImageTexture>(desc.string(t.path)));
+            break;
+        }
+    }
+
+    std::vector<shared_ptr<Material>> materials;
+    for (const MaterialRecord& m : desc.materials) {
+        switch (m.type) {
+        case MaterialRecord::LAMBERTIAN:
+            materials.push_back(make_shared<Lambertian>(textures[m.texture]));
+            break;
+        case MaterialRecord::METAL:
+            materials.push_back(
+                make_shared<Metal>(textures[m.texture], m.param));
+            break;
+        case MaterialRecord::DIELECTRIC:
+            materials.push_back(make_shared<Dielectric>(m.param));
+            break;
+        case MaterialRecord::LIGHT:
+            materials.push_back(
+                make_shared<DiffuseLight>(textures[m.texture]));
+            break;
+        case MaterialRecord::TWO_SIDED:
+            materials.push_back(make_shared<TwoSidedMaterial>(
+                materials[m.front],
+                materials[m.back]));
+            break;
+        }
+    }
+
+    scene.primitives.clear();
+    scene.primitives.reserve(desc.shapes.size());
+    for (const ShapeRecord& s : desc.shapes) {
+        const auto& mat = materials[s.material];
+        switch (s.type) {
+        case ShapeRecord::SPHERE:
+            scene.primitives.push_back(
+                make_shared<Sphere>(s.v[0], s.radius, mat));
+            break;
+        case ShapeRecord::QUAD:
+            scene.primitives.push_back(
+                make_shared<Quad>(s.v[0], s.v[1], s.v[2], mat));
+            break;
+        case ShapeRecord::TRIANGLE:
+            scene.primitives.push_back(
+                make_shared<Triangle>(s.v[0], s.v[1], s.v[2], mat));
+            break;
+        case ShapeRecord::PLANE:
+            planes.push_back(make_shared<Plane>(s.v[0], s.v[1], mat));
+            break;
+        case ShapeRecord::MESH: {
+            const MeshRecord& m = desc.meshes[s.mesh];
+            auto mesh           = Mesh::loadCached(desc.string(m.path));
+            if (!mesh) return false;
+            std::vector<shared_ptr<Material>> groupMaterials(
+                mesh->groupCount(),
+                mat);
+            for (uint32_t i = 0; i < m.groupCount; i++) {
+                const GroupMaterialRecord& g =
+                    desc.groupMaterials[m.firstGroup + i];
+                uint32_t group = 0;
+                while (group < mesh->groupCount()
+                       && mesh->groupName(group) != desc.string(g.group)) {
+                    group++;
+                }
+                if (group == mesh->groupCount()) {
+                    std::cerr << desc.string(m.path) << " has no group "
+                              << desc.string(g.group) << "\n";
+                    continue;
+                }
+                groupMaterials[group] = materials[g.material];
+            }
+            auto tris = mesh->triangles(groupMaterials);
+            scene.primitives.insert(
+                scene.primitives.end(),
+                tris.begin(),
+                tris.end());
+            scene.meshes.push_back(mesh);
+            break;
+        }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool loadSceneFile(
+    const std::string& filename,
+    Scene& scene,
+    const std::string& cacheDir)
+{
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file: " << filename << "\n";
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+
+    uint64_t key = sceneHash(text.str());
+    std::stringstream ss;
+    ss << cacheDir << "/" << std::hex << std::setw(16) << std::setfill('0')
+       << key << ".rtscene";
+    std::string cacheFilename = ss.str();
+
+    SceneDescription desc;
+    MappedFile cache;
+    bool loaded;
+    {
+        trace::Phase phase("scene.cache.load", "io");
+        loaded = loadCache(cacheFilename, key, cache, desc);
+    }
+    if (loaded) {
+        std::cerr << "Loaded scene " << desc.string(desc.name) << " of "
+                  << desc.shapes.size() << " shapes from cache "
+                  << cacheFilename << "\n";
+    } else {
+        trace::Phase phase("scene.parse", "build");
+        desc = SceneDescription();
+        text.seekg(0);
+        if (!Parser(filename, desc).parse(text)) return false;
+    }
+
+    if (!instantiate(desc, scene, scene.unbounded)) return false;
+    if (scene.primitives.empty() && scene.unbounded.empty()) {
+        std::cerr << filename << ": No shapes\n";
+        return false;
+    }
+
+    auto header = loaded ? cache.at<SceneCacheHeader>(0) : nullptr;
+    if (scene.primitives.empty()) {
+        scene.assembleWorld();
+        return true;
+    }
+    // The blikker_pt3::BVH goes into the scene cache, with the records
+    auto write = [&](const blikker_pt3::BVH* bvh) {
+        std::error_code ec;
+        fs::create_directories(cacheDir, ec);
+        writeCache(desc, bvh, key, cacheFilename);
+    };
+    BVHStore store;
+    if (header && header->nodes.count <= UINT32_MAX
+        && header->primIndices.count == scene.primitives.size()) {
+        using Node        = blikker_pt3::BVH::Node;
+        store.nodes       = cache.at<Node>(header->nodes.offset);
+        store.nodeCount   = header->nodes.count;
+        store.primIndices = cache.at<uint32_t>(header->primIndices.offset);
+    }
+    store.write = [&](const blikker_pt3::BVH& bvh) { write(&bvh); };
+    scene.buildBVH(&store);
+    // Without a hierarchy, the next run still skips the parse
+    if (!loaded && scene.accelerator != Scene::Accelerator::BVH) {
+        write(nullptr);
+    }
+    return true;
+}
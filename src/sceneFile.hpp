@@ -0,0 +1,126 @@
+/// @file sceneFile.hpp
+/// Text scene descriptions (`.scene`), and their compiled cache (`.rtscene`).
+///
+/// A scene file lists the camera, textures, materials and shapes of a scene,
+/// one statement per line, so scenes can be edited without rebuilding the
+/// renderer. See scenes/cornellBox.scene for the format.
+///
+/// Parsing produces flat records, with textures and materials as tables the
+/// records index into. Meshes are referred to by path, and mapped from their
+/// own cache (see mesh.hpp). The records are cached together with the
+/// blikker_pt3::BVH built over them, keyed by a hash of the file text, so an
+/// unchanged scene is restored without parsing or building.
+#pragma once
+
+#include "rtweekend.hpp"
+#include "scene.hpp"
+
+#include <cstdint>
+#include <string>
+
+/// @brief Render settings of a scene file, applied to Scene::cam.
+struct CameraRecord {
+    int32_t imageWidth;
+    int32_t samplesPerPixel;
+    int32_t maxDepth;
+    float aspectRatio;
+    float vfov;
+    float defocusAngle;
+    float focusDist;
+    Vec3 lookFrom;
+    Vec3 lookAt;
+    Vec3 vup;
+    Color background;
+};
+
+struct TextureRecord {
+    enum Type : uint32_t { SOLID, CHECKER, IMAGE };
+
+    Type type;
+    float scale;   ///< CHECKER field size
+    Color even;    ///< SOLID colour, or CHECKER even fields
+    Color odd;     ///< CHECKER odd fields
+    uint32_t path; ///< IMAGE file, offset into the string table
+};
+
+struct MaterialRecord {
+    enum Type : uint32_t { LAMBERTIAN, METAL, DIELECTRIC, LIGHT, TWO_SIDED };
+
+    Type type;
+    uint32_t texture; ///< Albedo or emission, index into the textures
+    uint32_t front;   ///< TWO_SIDED materials, indices into the materials
+    uint32_t back;
+    float param;      ///< METAL fuzz, DIELECTRIC refraction index
+};
+
+struct ShapeRecord {
+    enum Type : uint32_t { SPHERE, QUAD, TRIANGLE, PLANE, MESH };
+
+    Type type;
+    /// @brief Index into the materials, for a MESH that of the groups without
+    /// their own.
+    uint32_t material;
+    uint32_t mesh; ///< MESH index into the meshes
+    /// @brief SPHERE centre, QUAD corner and edges, TRIANGLE vertices, PLANE
+    /// point and normal.
+    Vec3 v[3];
+    float radius; ///< SPHERE radius
+};
+
+struct MeshRecord {
+    uint32_t path;       ///< Offset into the string table
+    uint32_t firstGroup; ///< Index into the group materials
+    uint32_t groupCount;
+};
+
+/// @brief Material of the triangles of a named mesh group.
+struct GroupMaterialRecord {
+    uint32_t group; ///< Group name, offset into the string table
+    uint32_t material;
+};
+
+/// @brief A file the scene was compiled from besides the scene file itself,
+/// as it was when compiled.
+struct DependencyRecord {
+    uint32_t path; ///< Offset into the string table
+    uint64_t size;
+    int64_t mtime;
+};
+
+struct SceneCacheHeader {
+    static constexpr char expectedMagic[8] = { 'R', 'T', 'S', 'C',
+                                               'E', 'N', 'E', '\0' };
+    static constexpr uint32_t currentVersion = 2;
+
+    struct Section {
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeSize; ///< sizeof(blikker_pt3::BVH::Node) when written
+    uint64_t key;      ///< Hash of the scene file and builder parameters
+    uint64_t name;     ///< Offset of the scene name into the string table
+    CameraRecord camera;
+    Section textures;
+    Section materials;
+    Section shapes;
+    Section meshes;
+    Section groupMaterials;
+    Section views;
+    Section strings; ///< Bytes of '\0' terminated strings
+    Section dependencies;
+    Section nodes; ///< Empty if no blikker_pt3::BVH was built
+    Section primIndices;
+};
+
+/// @brief Build `scene` from a scene file, through the compiled scene cache
+/// `<cacheDir>/<hash>.rtscene`. Shapes go into the `scene.accelerator`,
+/// except planes, which are unbounded and tested next to it.
+/// @param cacheDir Created if missing.
+/// @return False if the file is missing or invalid, after printing why.
+bool loadSceneFile(
+    const std::string& filename,
+    Scene& scene,
+    const std::string& cacheDir = "runtime/cache");
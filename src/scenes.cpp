@@ -0,0 +1,494 @@
+#include "scenes.hpp"
+
+#include "hittableList.hpp"
+#include "material.hpp"
+#include "mesh.hpp"
+#include "shape/plane.hpp"
+#include "shape/quad.hpp"
+#include "shape/sphere.hpp"
+#include "shape/triangle.hpp"
+
+#include <glm/glm.hpp>
+
+namespace {
+
+const int N_MATERIALS                       = 9;
+shared_ptr<Material> materials[N_MATERIALS] = {
+    make_shared<Lambertian>(Color(0.1, 0.1, 0.1)),
+    make_shared<Lambertian>(Color(1.0, 0.05, 0.05)),
+    make_shared<Lambertian>(Color(0.05, 1.0, 0.05)),
+    make_shared<Lambertian>(Color(0.05, 0.05, 1.0)),
+    make_shared<Metal>(Color(1.0, 0.6, 0.6)),
+    make_shared<Metal>(Color(1.0, 0.6, 0.6), 0.5),
+    make_shared<Metal>(Color(0.5, 0.5, 0.5), 0.2),
+    make_shared<Metal>(Color(0.99, 0.99, 0.5), 0.2),
+    make_shared<Dielectric>(1.5),
+};
+auto matLambDark  = make_shared<Lambertian>(Color(0.1, 0.1, 0.1));
+auto matLambRed   = make_shared<Lambertian>(Color(1.0, 0.05, 0.05));
+auto matLambGreen = make_shared<Lambertian>(Color(0.05, 1.0, 0.05));
+auto matLambBlue  = make_shared<Lambertian>(Color(0.05, 0.05, 1.0));
+auto matMetRed    = make_shared<Metal>(Color(1.0, 0.6, 0.6));
+auto matMetRed2   = make_shared<Metal>(Color(1.0, 0.6, 0.6), 0.5);
+auto matMetDark   = make_shared<Metal>(Color(0.5, 0.5, 0.5), 0.2);
+auto matMetLight  = make_shared<Metal>(Color(0.99, 0.99, 0.5), 0.2);
+auto matRG        = make_shared<TwoSidedMaterial>(matMetDark, matLambGreen);
+auto dielectric   = make_shared<Dielectric>(1.5);
+
+HittableList spheres()
+{
+    // World
+    HittableList world;
+    // Visualise axes:
+    // world.add(make_shared<Sphere>(Vec3( 0.5, -0.5, -2), 0.2, matLambRed));
+    // world.add(make_shared<Sphere>(Vec3(-0.5,  0.5, -2), 0.2, matLambGreen));
+    // world.add(make_shared<Sphere>(Vec3(-0.5, -0.5, -1), 0.2, matLambBlue));
+    // world.add(make_shared<Sphere>(Vec3(-0.5, -0.5, -2), 0.2, matLambDark));
+
+    world.add(make_shared<Sphere>(Vec3(-1, 0, -2), -0.5, dielectric));
+    world.add(make_shared<Sphere>(Vec3(1, 0, -2), 0.5, matMetRed));
+    // world.add(make_shared<Sphere>(Vec3(0, 0, -1), 0.5, matLambRed));
+    world.add(make_shared<Sphere>(Vec3(0, 0, -2), 0.5, matMetRed2));
+
+    world.add(make_shared<Sphere>(Vec3(10.0, 1.0, -4.0), 1.5, matLambBlue));
+    world.add(make_shared<Sphere>(Vec3(1.0, 1.0, -6.0), 1.5, matMetRed2));
+    world.add(make_shared<Sphere>(Vec3(-3.0, 1.0, -5.0), 1.5, matMetLight));
+
+    world.add(make_shared<Sphere>(Vec3(0, -50.5, -2), 50.0, matMetDark));
+    world.add(make_shared<Plane>(Vec3(0, -0.5, -4), Vec3(0, 1, 0), matRG));
+
+    return world;
+}
+
+HittableList spheresAndTris()
+{
+    HittableList world = spheres();
+    world.add(make_shared<Triangle>( // Cw pointing down
+        Vec3(0.0, 0.2, -1.0),
+        Vec3(2.0, 1.5, -1.0),
+        Vec3(0.0, 1.0, -0.9),
+        matRG));
+    world.add(make_shared<Triangle>( // CW pointing down
+        Vec3(1.0, 0.1, -1.0),
+        Vec3(0.5, -0.3, -0.5),
+        Vec3(0.2, 0.0, -0.8),
+        matRG));
+    world.add(make_shared<Triangle>( // CW pointing up
+        Vec3(-0.2, 0.0, -0.8),
+        Vec3(-1.0, 0.1, -1.0),
+        Vec3(-0.5, -0.3, -0.5),
+        matRG));
+    world.add(make_shared<Triangle>( // CW pointing up
+        Vec3(0.1, -0.5, 0.1),
+        Vec3(1.0, 0.0, 0.5),
+        Vec3(0.5, 0.0, 0.1),
+        dielectric));
+
+    return world;
+}
+
+std::vector<shared_ptr<Primitive>> triangles(int count)
+{
+    auto tris     = std::vector<shared_ptr<Primitive>>(count);
+    float maxPos  = 2.5;
+    float maxEdge = 0.5;
+    for (int i = 0; i < count; i++) {
+
+        Vec3 v0 = (Vec3(randomFloat(), randomFloat(), randomFloat()) - 0.5f)
+                * maxPos * 2.0f;
+        Vec3 v1 = (Vec3(randomFloat(), randomFloat(), randomFloat()) - 0.5f)
+                * maxEdge * 2.0f;
+        Vec3 v2 = (Vec3(randomFloat(), randomFloat(), randomFloat()) - 0.5f)
+                * maxEdge * 2.0f;
+
+        tris[i] = make_shared<Triangle>(
+            v0,
+            v0 + v1,
+            v0 + v2,
+            materials[0]); //[randomInt(0, N_MATERIALS)]);
+    }
+    return tris;
+}
+
+std::vector<shared_ptr<Primitive>> box()
+{
+    Vec3 center = Vec3(0.0);
+    Vec3 s      = Vec3(2.0);
+    auto mat    = matLambRed;
+
+    Vec3 v[] = {
+        center + Vec3(s.x, s.y, s.z),    // 0
+        center + Vec3(s.x, s.y, -s.z),   // 1
+        center + Vec3(s.x, -s.y, s.z),   // 2
+        center + Vec3(s.x, -s.y, -s.z),  // 3
+        center + Vec3(-s.x, s.y, s.z),   // 4
+        center + Vec3(-s.x, s.y, -s.z),  // 5
+        center + Vec3(-s.x, -s.y, s.z),  // 6
+        center + Vec3(-s.x, -s.y, -s.z), // 7
+    };
+
+    auto tris = std::vector<shared_ptr<Primitive>>({
+        make_shared<Triangle>(v[0], v[1], v[3], mat),
+        make_shared<Triangle>(v[0], v[3], v[2], mat),
+        make_shared<Triangle>(v[0], v[4], v[5], mat),
+        make_shared<Triangle>(v[0], v[5], v[1], mat),
+        make_shared<Triangle>(v[0], v[6], v[4], mat),
+        make_shared<Triangle>(v[0], v[2], v[6], mat),
+        make_shared<Triangle>(v[7], v[5], v[4], mat),
+        make_shared<Triangle>(v[7], v[4], v[6], mat),
+        make_shared<Triangle>(v[7], v[6], v[2], mat),
+        make_shared<Triangle>(v[7], v[2], v[3], mat),
+        make_shared<Triangle>(v[7], v[3], v[1], mat),
+        make_shared<Triangle>(v[7], v[1], v[5], mat),
+    });
+    return tris;
+}
+
+} // namespace
+
+void buildOneBox(Scene& scene)
+{
+    scene.name = "cube";
+
+    Camera& cam         = scene.cam;
+    cam.imageWidth      = 300;
+    cam.aspectRatio     = 16.0 / 9.0;
+    cam.samplesPerPixel = 100;
+    cam.lookAt          = Vec3(0.0, 0.0, 3.0);
+    cam.lookFrom        = Vec3(0.0, 0.0, 4.0);
+    cam.defocusAngle    = 0.000001;
+
+    scene.primitives = box();
+    scene.buildBVH();
+}
+
+void buildOneSphere(Scene& scene)
+{
+    scene.name = "sphere";
+
+    Camera& cam         = scene.cam;
+    cam.imageWidth      = 300;
+    cam.aspectRatio     = 16.0 / 9.0;
+    cam.vfov            = 90;
+    cam.samplesPerPixel = 100;
+    cam.lookAt          = Vec3(0.0, 0.0, 0.0);
+    cam.lookFrom        = Vec3(0.0, 0.0, 2.5);
+    cam.focusDist       = 2.0;
+    cam.defocusAngle    = 0.000001;
+
+    auto mat1 = make_shared<Metal>(Color(0.2, 0.2, 1.0), 0.1);
+
+    scene.world = make_shared<Sphere>(Vec3(0.0), 1.0, mat1);
+}
+
+void buildEarth(Scene& scene)
+{
+    scene.name = "earth";
+
+    Camera& cam         = scene.cam;
+    cam.imageWidth      = 800;
+    cam.aspectRatio     = 16.0 / 9.0;
+    cam.vfov            = 90;
+    cam.samplesPerPixel = 100;
+    cam.lookAt          = Vec3(0.0, 0.0, 0.0);
+    cam.lookFrom        = Vec3(0.0, 1.0, -3.0);
+    cam.focusDist       = 1.5;
+    cam.defocusAngle    = 0.0;
+
+    auto imgTexEarth = make_shared<ImageTexture>("resources/earthmap.jpg");
+    auto matEarthmap = make_shared<Lambertian>(imgTexEarth);
+    scene.world = make_shared<Sphere>(Vec3(0.0, 0.0, 0.0), 2.0, matEarthmap);
+}
+
+void buildTwoSpheres(Scene& scene)
+{
+    scene.name = "2spheres";
+
+    Camera& cam         = scene.cam;
+    cam.imageWidth      = 600;
+    cam.aspectRatio     = 16.0 / 9.0;
+    cam.vfov            = 80;
+    cam.samplesPerPixel = 100;
+    cam.lookAt          = Vec3(-1.25, 0.0, 0.0);
+    cam.lookFrom        = Vec3(-1.25, 2.0, 0.1);
+    cam.focusDist       = 1.5;
+    cam.defocusAngle    = 0.0;
+
+    // STBImage tex("resources/cgaxis_hdri_skies_01_52.jpg");
+    auto imgTex =
+        make_shared<ImageTexture>("resources/cgaxis_hdri_skies_01_52.jpg");
+    auto imgTexEarth = make_shared<ImageTexture>("resources/earthmap.jpg");
+    imgTex->repeatedTexture = 1.0;
+
+    auto checker =
+        make_shared<CheckerTexture>(0.025, Color(1.0), Color(0.0, 0.0, 1.0));
+    auto grad = make_shared<GradientTexture>(
+        Color(1.0, 0.0, 0.0),
+        Color(0.0, 0.0, 1.0),
+        true,
+        false);
+    auto mat1 = make_shared<Metal>(checker, 0.1);
+    // auto mat2 = make_shared<Metal>(Color(0.95, 0.95, 0.95), 0.6);
+    auto mat2 = make_shared<Lambertian>(imgTexEarth);
+    // auto mat2 = make_shared<Lambertian>(grad);
+
+    auto world = make_shared<HittableList>();
+
+    world->add(make_shared<Sphere>(Vec3(1.25, 0.0, 0.0), 1.0, mat1));
+    world->add(make_shared<Sphere>(Vec3(-1.25, 0.0, 0.0), 1.0, mat2));
+    scene.world = world;
+}
+
+void buildQuads(Scene& scene)
+{
+    scene.name = "quads";
+
+    Camera& cam         = scene.cam;
+    cam.imageWidth      = 400;
+    cam.aspectRatio     = 1.0;
+    cam.vfov            = 80;
+    cam.samplesPerPixel = 100;
+    cam.lookAt          = Vec3(0.0, 0.0, 0.0);
+    cam.lookFrom        = Vec3(0.0, 0.0, 9.0);
+    cam.vup             = Vec3(0.0, 1.0, 0.0);
+    cam.focusDist       = 1.5;
+    cam.defocusAngle    = 0.0;
+
+    auto leftRed     = make_shared<Lambertian>(Color(1.0, 0.2, 0.2));
+    auto backGreen   = make_shared<Lambertian>(Color(0.2, 1.0, 0.2));
+    auto rightBlue   = make_shared<Lambertian>(Color(0.2, 0.2, 1.0));
+    auto upperOrange = make_shared<Lambertian>(Color(1.0, 0.5, 0.0));
+    auto lowerTeal   = make_shared<Lambertian>(Color(0.2, 0.8, 0.8));
+
+    auto world = make_shared<HittableList>();
+    world->add(make_shared<Quad>(
+        Vec3(-3, -2, 5),
+        Vec3(0, 0, -4),
+        Vec3(0, 4, 0),
+        leftRed));
+    world->add(make_shared<Quad>(
+        Vec3(-2, -2, 0),
+        Vec3(4, 0, 0),
+        Vec3(0, 4, 0),
+        backGreen));
+    world->add(make_shared<Quad>(
+        Vec3(3, -2, 1),
+        Vec3(0, 0, 4),
+        Vec3(0, 4, 0),
+        rightBlue));
+    world->add(make_shared<Quad>(
+        Vec3(-2, 3, 1),
+        Vec3(4, 0, 0),
+        Vec3(0, 0, 4),
+        upperOrange));
+    world->add(make_shared<Quad>(
+        Vec3(-2, -3, 5),
+        Vec3(4, 0, 0),
+        Vec3(0, 0, -4),
+        lowerTeal));
+    scene.world = world;
+}
+
+void buildTriangles(Scene& scene, int nTris = 32)
+{
+    scene.name = "triangles-" + std::to_string(nTris) + "pc";
+
+    Camera& cam         = scene.cam;
+    cam.imageWidth      = 400;
+    cam.aspectRatio     = 1.0;
+    cam.vfov            = 80;
+    cam.samplesPerPixel = 100;
+    cam.lookAt          = Vec3(0.0, 0.0, 0.0);
+    cam.lookFrom        = Vec3(0.0, 0.0, 9.0);
+    cam.vup             = Vec3(0.0, 1.0, 0.0);
+    cam.focusDist       = 1.5;
+    cam.defocusAngle    = 0.0;
+
+    scene.primitives = triangles(nTris);
+    scene.buildBVH();
+}
+
+void buildUnityMesh(Scene& scene)
+{
+    scene.name = "unityMesh";
+
+    Camera& cam         = scene.cam;
+    cam.imageWidth      = 400;
+    cam.aspectRatio     = 4.0 / 3.0;
+    cam.vfov            = 80;
+    cam.samplesPerPixel = 50;
+    cam.maxDepth        = 15; // default 10
+    cam.lookAt          = Vec3(-1.1, 0.0, -0.5);
+    cam.lookFrom        = Vec3(-1.3, 0.2, 2.4);
+    cam.vup             = Vec3(0.0, 1.0, 0.0);
+    cam.focusDist       = 1.5;
+    cam.defocusAngle    = 0.0;
+
+    // Keep the mesh alive for as long as its triangles are in use.
+    auto mesh    = Mesh::loadCached("resources/unity.tri");
+    auto& tris   = scene.primitives;
+    tris         = mesh->triangles(
+        make_shared<Lambertian>(Color(0.82, 0.82, 0.82)));
+    scene.meshes = { mesh };
+    auto light   = make_shared<DiffuseLight>(Color(30.0));
+    float yPlane = -1.3;
+    tris.push_back(make_shared<Triangle>(
+        Vec3(1.0, yPlane, 1.0),
+        Vec3(0.0, yPlane, 1.0),
+        Vec3(0.0, yPlane, -1.0),
+        matMetRed2));
+    tris.push_back(make_shared<Triangle>(
+        Vec3(1.0, yPlane, 1.0),
+        Vec3(0.0, yPlane, -1.0),
+        Vec3(1.0, yPlane, -1.0),
+        matMetRed2));
+    tris.push_back(make_shared<Triangle>(
+        Vec3(0.0, yPlane, 2.0),
+        Vec3(-4.0, yPlane, 2.0),
+        Vec3(-4.0, yPlane, -2.0),
+        matMetLight));
+    tris.push_back(make_shared<Triangle>(
+        Vec3(0.0, yPlane, 2.0),
+        Vec3(-4.0, yPlane, -2.0),
+        Vec3(0.0, yPlane, -2.0),
+        matMetLight));
+
+    tris.push_back(make_shared<Triangle>(
+        Vec3(1.0, 0.0, 0.0),
+        Vec3(1.0, 0.0, 1.0),
+        Vec3(1.0, 0.5, 1.0),
+        light));
+
+    scene.buildBVH();
+    // std::cerr << world.tree(0) << "\n";
+
+    scene.views = { Vec3(-1.0, 0.2, 2.8), Vec3(-1.0, 2.0, 1.8) };
+}
+
+void buildSimpleLight(Scene& scene)
+{
+    scene.name = "simpleLight";
+    auto tex = make_shared<Lambertian>(Color(0.8, 0.1, 0.2));
+
+    auto difflight1 = make_shared<DiffuseLight>(Color(4.0));
+    auto difflight2 = make_shared<DiffuseLight>(Color(16.0));
+
+    scene.primitives = std::vector<shared_ptr<Primitive>>({
+        make_shared<Sphere>(Vec3(0.0, -1000.0, 0.0), 1000.0, tex),
+        make_shared<Sphere>(Vec3(0.0, 2.0, 0.0), 2.0, tex),
+        make_shared<Sphere>(Vec3(0.0, 8.0, 0.0), 1.5, difflight2),
+        make_shared<Quad>(
+            Vec3(3.0, 1.0, -2),
+            Vec3(2.0, 0.0, 0.0),
+            Vec3(0.0, 2.0, 0.0),
+            difflight1),
+    });
+
+    scene.buildBVH();
+
+    Camera& cam         = scene.cam;
+    cam.imageWidth      = 600;
+    cam.aspectRatio     = 16.0 / 9.0;
+    cam.samplesPerPixel = 100;
+    cam.maxDepth        = 50;
+    cam.vfov            = 20;
+    cam.lookFrom        = Vec3(26, 3, 6);
+    cam.lookAt          = Vec3(0.0, 2.0, 0.0);
+    cam.vup             = Vec3(0.0, 1.0, 0.0);
+    cam.defocusAngle    = 0.0;
+    cam.background      = Color(0.0);
+}
+
+void buildMaterials(Scene& scene)
+{
+    scene.name = "materials";
+
+    // Mixes Lambertian, Metal and Dielectric, as well as a two-sided material
+    Camera& cam         = scene.cam;
+    cam.imageWidth      = 600;
+    cam.aspectRatio     = 16.0 / 9.0;
+    cam.vfov            = 70;
+    cam.samplesPerPixel = 100;
+    cam.maxDepth        = 20;
+    cam.lookAt          = Vec3(0.0, 0.0, -2.0);
+    cam.lookFrom        = Vec3(0.0, 0.6, 1.5);
+    cam.vup             = Vec3(0.0, 1.0, 0.0);
+    cam.focusDist       = 3.5;
+    cam.defocusAngle    = 0.0;
+    cam.background      = Color(0.7, 0.8, 1.0);
+
+    scene.world = make_shared<HittableList>(spheresAndTris());
+}
+
+void buildCornellBox(Scene& scene)
+{
+    scene.name = "cornellBox";
+
+    Camera& cam         = scene.cam;
+    cam.imageWidth      = 600;
+    cam.aspectRatio     = 1.0;
+    cam.vfov            = 40;
+    cam.samplesPerPixel = 200;
+    cam.maxDepth        = 50; // default 10
+    cam.lookAt          = Vec3(278.0, 278.0, 0.0);
+    cam.lookFrom        = Vec3(278.0, 278.0, -800.0);
+    cam.vup             = Vec3(0.0, 1.0, 0.0);
+    cam.focusDist       = 1.5;
+    cam.defocusAngle    = 0.0;
+
+    auto red   = make_shared<Lambertian>(Color(.65, .05, .05));
+    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
+    auto green = make_shared<Lambertian>(Color(.12, .45, .15));
+    auto light = make_shared<DiffuseLight>(Color(15, 15, 15));
+
+    // Make empty cornell box
+    scene.primitives = std::vector<shared_ptr<Primitive>>({
+        make_shared<Quad>(
+            Vec3(555, 0, 0),
+            Vec3(0, 555, 0),
+            Vec3(0, 0, 555),
+            green),
+        make_shared<Quad>(Vec3(0, 0, 0), Vec3(0, 555, 0), Vec3(0, 0, 555), red),
+        make_shared<Quad>(
+            Vec3(343, 554, 332),
+            Vec3(-130, 0, 0),
+            Vec3(0, 0, -105),
+            light),
+        make_shared<Quad>(
+            Vec3(0, 0, 0),
+            Vec3(555, 0, 0),
+            Vec3(0, 0, 555),
+            white),
+        make_shared<Quad>(
+            Vec3(555, 555, 555),
+            Vec3(-555, 0, 0),
+            Vec3(0, 0, -555),
+            white),
+        make_shared<Quad>(
+            Vec3(0, 0, 555),
+            Vec3(555, 0, 0),
+            Vec3(0, 555, 0),
+            white),
+    });
+
+    scene.buildBVH();
+}
+
+
+bool buildScene(int n, Scene& scene)
+{
+    seedRandom(n);
+    switch (n) {
+    case 1: buildEarth(scene); break;
+    case 2: buildQuads(scene); break;          // Best time 21645ms
+    case 3: buildOneBox(scene); break;         // Best time 7804ms
+    case 4: buildTriangles(scene, 178); break; // 178 tris best time 8351ms
+    case 5: buildTriangles(scene, 512); break; // 512 tris best time 14183ms
+    case 6: buildUnityMesh(scene); break; // 100 samples/14 depth 93602ms
+    case 7: buildSimpleLight(scene); break;
+    case 8: buildCornellBox(scene); break;
+    case 9: buildMaterials(scene); break;
+    default: return false;
+    }
+    return true;
+}
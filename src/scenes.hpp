@@ -0,0 +1,14 @@
+/// @file scenes.hpp
+/// The built-in scenes, selected by number on the command line and shared by
+/// the renderer and the regression tests.
+#pragma once
+
+#include "scene.hpp"
+
+/// @brief Number of built-in scenes, numbered 1 to N_SCENES.
+const int N_SCENES = 9;
+
+/// @brief Build scene number `n`, as selected on the command line. Scenes with
+/// random content are the same whichever scenes were built before.
+/// @return False if there is no such scene.
+bool buildScene(int n, Scene& scene);
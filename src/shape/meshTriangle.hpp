@@ -0,0 +1,48 @@
+/// @file shape/meshTriangle.hpp
+/// Triangle referencing its vertices in an indexed Mesh, instead of holding
+/// copies of them.
+#pragma once
+
+#include "hittable.hpp"
+#include "mesh.hpp"
+#include "rtweekend.hpp"
+#include "shape/triangle.hpp"
+
+class MeshTriangle : public Primitive {
+public:
+    MeshTriangle(const Mesh* mesh, uint32_t idx, shared_ptr<Material> m)
+        : mesh(mesh)
+        , idx(idx)
+        , mat(m)
+    { }
+    virtual ~MeshTriangle() = default;
+
+    bool
+    hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const override
+    {
+        const Vec3& v0 = mesh->vertex(idx, 0);
+        const Vec3& v1 = mesh->vertex(idx, 1);
+        const Vec3& v2 = mesh->vertex(idx, 2);
+        if (!Triangle::intersect(v0, v1, v2, r, tMin, tMax, rec)) return false;
+        mesh->interpolate(idx, rec);
+        rec.mat = mat;
+        return true;
+    }
+    Vec3 centroid() const override
+    {
+        return (mesh->vertex(idx, 0) + mesh->vertex(idx, 1)
+                + mesh->vertex(idx, 2))
+             * 0.333f;
+    }
+    void growAABB(Aabb& aabb) const override
+    {
+        aabb.grow(mesh->vertex(idx, 0));
+        aabb.grow(mesh->vertex(idx, 1));
+        aabb.grow(mesh->vertex(idx, 2));
+    }
+
+private:
+    const Mesh* mesh;
+    uint32_t idx;
+    shared_ptr<Material> mat;
+};
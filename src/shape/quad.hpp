@@ -20,7 +20,7 @@ public:
     bool
     hit(const Ray& ray, float tMin, float tMax, HitRecord& rec) const override
     {
-        quadIntersections++;
+        stats::add(stats::QUAD_TESTS);
         // https://raytracing.github.io/books/RayTracingTheNextWeek.html
         // #quadrilaterals/ray-planeintersection
         auto n      = glm::cross(uEdge, vEdge);
@@ -2,7 +2,7 @@
 
 bool Sphere::hit(const Ray& ray, float tMin, float tMax, HitRecord& rec) const
 {
-    sphereIntersections++;
+    stats::add(stats::SPHERE_TESTS);
     Vec3 oc     = ray.origin - center;
     auto a      = glm::dot(ray.direction, ray.direction);
     auto half_b = glm::dot(oc, ray.direction);
@@ -23,22 +23,49 @@ public:
     }
     virtual ~Triangle() = default;
 
+    /// @brief Move the triangle, for animation. A BVH over it must be
+    /// refitted or rebuilt afterwards.
+    void setVertices(Vec3 v0, Vec3 v1, Vec3 v2) {
+        vertices[0] = v0;
+        vertices[1] = v1;
+        vertices[2] = v2;
+        mCentroid   = (v0 + v1 + v2) * 0.333f;
+    }
+
     /// @brief Mõller-Trumbore triangle intersection. Assumes clockwise normal.
     /// @return
     bool
     hit(const Ray& r, float tMin, float tMax, HitRecord& rec) const override {
-        triIntersections++; // Counting total no. of intersections.
+        const Vec3* v = vertices;
+        if (!intersect(v[0], v[1], v[2], r, tMin, tMax, rec)) return false;
+        rec.mat = mat;
+        return true;
+    }
+
+    /// @brief Mõller-Trumbore intersection of a triangle given by its
+    /// vertices, shared by all triangle primitives regardless of how the
+    /// vertices are stored. Sets t, p and the face normal of `rec`, and the
+    /// barycentric coordinates of v1 and v2 as the texture coordinates.
+    static bool intersect(
+        const Vec3& v0,
+        const Vec3& v1,
+        const Vec3& v2,
+        const Ray& r,
+        float tMin,
+        float tMax,
+        HitRecord& rec) {
+        stats::add(stats::TRI_TESTS);
         const float epsilon = nearZero;
 
-        const auto edge1 = vertices[1] - vertices[0];
-        const auto edge2 = vertices[2] - vertices[0];
+        const auto edge1 = v1 - v0;
+        const auto edge2 = v2 - v0;
         const auto h     = glm::cross(r.direction, edge2);
         const auto a     = glm::dot(edge1, h);
 
         if (-epsilon < a && a < epsilon) return false; // Ray parallel
 
         const auto f = 1 / a;
-        const auto s = r.origin - vertices[0];
+        const auto s = r.origin - v0;
         const auto u = f * glm::dot(s, h);
 
         if (u < 0 || 1 < u) return false;
@@ -54,9 +81,10 @@ public:
 
         rec.t       = t;
         rec.p       = r.at(t);
+        rec.u       = u;
+        rec.v       = v;
         Vec3 normal = glm::cross(edge1, edge2);
         rec.setFaceNormal(r, normal);
-        rec.mat = mat;
         return true;
     }
     Vec3 centroid() const override { return mCentroid; }
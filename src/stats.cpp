@@ -0,0 +1,67 @@
+#include "stats.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace stats {
+
+bool enabled = true;
+
+namespace {
+
+std::mutex registryMutex;
+std::vector<Counters*> registry;
+/// @brief Counts of threads that have exited.
+Counters retired;
+
+/// @brief Owns a thread's counters, folding them into `retired` on exit.
+struct ThreadCounters {
+    Counters* counters;
+
+    ThreadCounters() : counters(new Counters())
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(counters);
+    }
+    ~ThreadCounters()
+    {
+        detail::current = nullptr;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (int c = 0; c < COUNTER_COUNT; c++) {
+            retired.values[c] += counters->values[c];
+        }
+        registry.erase(std::find(registry.begin(), registry.end(), counters));
+        delete counters;
+    }
+};
+
+} // namespace
+
+Counters& detail::registerThread()
+{
+    thread_local ThreadCounters threadCounters;
+    current = threadCounters.counters;
+    return *current;
+}
+
+Counters total()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    Counters sum = retired;
+    for (const Counters* counters : registry) {
+        for (int c = 0; c < COUNTER_COUNT; c++) {
+            sum.values[c] += counters->values[c];
+        }
+    }
+    return sum;
+}
+
+void reset()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    retired = Counters();
+    for (Counters* counters : registry) *counters = Counters();
+}
+
+} // namespace stats
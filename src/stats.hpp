@@ -0,0 +1,74 @@
+/// @file stats.hpp
+/// Render statistics: rays traced, BVH node visits and intersection tests.
+///
+/// Every thread counts into its own cache line aligned counters, which are
+/// only merged when read with total(), so counting never contends between
+/// threads. Counting can be switched off at runtime with `stats::enabled`, or
+/// removed at compile time by building with RT_STATS=0 (meson option
+/// `-Dstats=false`), in which case add() compiles to nothing.
+#pragma once
+
+#include <cstdint>
+
+#ifndef RT_STATS
+#define RT_STATS 1
+#endif
+
+namespace stats {
+
+enum Counter {
+    RAYS,         ///< Rays traced through the scene
+    NODE_VISITS,  ///< Acceleration structure nodes visited
+    AABB_TESTS,   ///< Ray-AABB tests
+    TRI_TESTS,    ///< Ray-triangle tests
+    SPHERE_TESTS, ///< Ray-sphere tests
+    QUAD_TESTS,   ///< Ray-quad tests
+    /// @brief Rays entering an Instance, tests of its BLAS are counted apart
+    INSTANCE_TESTS,
+    RENDER_NS,    ///< Wall clock time spent in Camera::render()
+    COUNTER_COUNT,
+};
+
+struct alignas(64) Counters {
+    uint64_t values[COUNTER_COUNT] = {};
+
+    uint64_t operator[](Counter c) const { return values[c]; }
+    uint64_t primitiveTests() const
+    {
+        return values[TRI_TESTS] + values[SPHERE_TESTS] + values[QUAD_TESTS];
+    }
+};
+
+/// @brief Runtime switch, counting is on by default when compiled in.
+extern bool enabled;
+
+namespace detail {
+/// @brief The calling thread's counters once registered. Constant
+/// initialized, so reading it is a plain thread local load, without the
+/// initialization check of a thread local object.
+inline thread_local Counters* current = nullptr;
+/// @brief Register counters for the calling thread and set `current`.
+Counters& registerThread();
+} // namespace detail
+
+/// @brief Counters of the calling thread, registered on first use.
+inline Counters& local()
+{
+    Counters* counters = detail::current;
+    return counters ? *counters : detail::registerThread();
+}
+
+inline void add([[maybe_unused]] Counter c, [[maybe_unused]] uint64_t n = 1)
+{
+#if RT_STATS
+    if (enabled) local().values[c] += n;
+#endif
+}
+
+/// @brief Sum of the counters of all threads, including exited ones.
+Counters total();
+
+/// @brief Zero the counters of all threads.
+void reset();
+
+} // namespace stats
@@ -0,0 +1,104 @@
+#include "trace.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace trace {
+
+bool enabled = false;
+
+namespace {
+
+struct Event {
+    const char* name;
+    const char* category;
+    uint64_t startNs;
+    uint64_t endNs;
+    int64_t arg;
+};
+
+struct ThreadBuffer {
+    explicit ThreadBuffer(uint32_t tid)
+        : tid(tid)
+    { }
+
+    uint32_t tid;
+    std::vector<Event> events;
+};
+
+std::mutex registryMutex;
+/// @brief Buffers of all threads that ever recorded, kept after thread exit.
+std::vector<ThreadBuffer*> registry;
+
+ThreadBuffer& localBuffer()
+{
+    thread_local ThreadBuffer* buffer = [] {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        auto* b = new ThreadBuffer(static_cast<uint32_t>(registry.size()));
+        registry.push_back(b);
+        return b;
+    }();
+    return *buffer;
+}
+
+} // namespace
+
+uint64_t now()
+{
+    static const auto epoch = std::chrono::steady_clock::now();
+    // Never 0, Zone uses 0 for "not recording"
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - epoch)
+               .count()
+         + 1;
+}
+
+void record(
+    const char* name,
+    const char* category,
+    uint64_t startNs,
+    uint64_t endNs,
+    int64_t arg)
+{
+    localBuffer().events.push_back({ name, category, startNs, endNs, arg });
+}
+
+bool writeJson(const std::string& filename)
+{
+    std::ofstream f(filename);
+    if (!f.is_open()) {
+        std::cerr << "Failed to open file: " << filename << "\n";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    size_t count = 0;
+    f << std::fixed << std::setprecision(3);
+    f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (const ThreadBuffer* buffer : registry) {
+        f << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+          << buffer->tid << ",\"args\":{\"name\":\"thread "
+          << buffer->tid << "\"}},\n";
+        for (const Event& e : buffer->events) {
+            // Timestamps are in microseconds
+            f << "{\"name\":\"" << e.name << "\",\"cat\":\"" << e.category
+              << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+              << ",\"ts\":" << e.startNs / 1e3
+              << ",\"dur\":" << (e.endNs - e.startNs) / 1e3;
+            if (e.arg >= 0) f << ",\"args\":{\"id\":" << e.arg << "}";
+            f << "},\n";
+            count++;
+        }
+    }
+    // Chrome accepts a trailing comma, but strict JSON parsers do not.
+    f << "{\"name\":\"end\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,"
+      << "\"ts\":" << now() / 1e3 << "}\n]}\n";
+    std::cerr << "Wrote " << count << " trace events to " << filename << "\n";
+    return true;
+}
+
+} // namespace trace
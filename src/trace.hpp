@@ -0,0 +1,86 @@
+/// @file trace.hpp
+/// Timeline tracing of render phases, exported as Chrome trace events (open in
+/// chrome://tracing or ui.perfetto.dev).
+///
+/// A `trace::Zone` records the span between its construction and destruction
+/// on the calling thread. Every thread appends to its own buffer, so recording
+/// takes no locks; buffers are only merged by writeJson(). Tracing is off
+/// unless `trace::enabled` is set, in which case a zone costs one branch.
+///
+/// A `trace::Phase` is a zone that also runs a ScopedTimer, so a phase shows
+/// both on the timeline and in the timer report.
+#pragma once
+
+#include "taskTimer.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace trace {
+
+/// @brief Runtime switch, off by default.
+extern bool enabled;
+
+/// @brief Nanoseconds since the first call, on the monotonic clock.
+uint64_t now();
+
+/// @brief Append a complete event to the calling thread's buffer.
+/// @param name Static string, not copied
+/// @param category Static string, not copied
+/// @param arg Shown as the event's `id` argument, if not negative
+void record(
+    const char* name,
+    const char* category,
+    uint64_t startNs,
+    uint64_t endNs,
+    int64_t arg = -1);
+
+/// @brief Write all recorded events as Chrome trace event JSON.
+/// @return False if the file could not be written.
+bool writeJson(const std::string& filename);
+
+/// @brief Scoped span, recorded when it goes out of scope. A null name
+/// records nothing, for sites that only trace some of their calls.
+class Zone {
+public:
+    Zone(const char* name, const char* category = "rt", int64_t arg = -1)
+        : name(name)
+        , category(category)
+        , arg(arg)
+        , start(enabled && name ? now() : 0)
+    { }
+    ~Zone()
+    {
+        if (enabled && start) record(name, category, start, now(), arg);
+    }
+    Zone(const Zone&)            = delete;
+    Zone& operator=(const Zone&) = delete;
+
+private:
+    const char* name;
+    const char* category;
+    int64_t arg;
+    uint64_t start;
+};
+
+/// @brief A Zone and a ScopedTimer over the same span.
+class Phase {
+public:
+    /// @param timerName Name in the timer report, the zone's name if null
+    Phase(
+        const char* name,
+        const char* category = "rt",
+        const char* timerName = nullptr)
+        : zone(name, category)
+        , timer(timerName ? timerName : name)
+    { }
+
+    uint64_t elapsedNs() const { return timer.elapsedNs(); }
+    const ScopedTimer& scopedTimer() const { return timer; }
+
+private:
+    Zone zone;
+    ScopedTimer timer;
+};
+
+} // namespace trace
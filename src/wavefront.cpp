@@ -0,0 +1,233 @@
+#include "wavefront.hpp"
+
+#include "perfCounters.hpp"
+
+#include <omp.h>
+
+#include <array>
+
+namespace {
+
+/// @brief Spread the lower 10 bits of `v` to every third bit.
+uint32_t expandBits(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+/// @brief Sort key of a ray: 27 bit Morton code of its origin, quantised to
+/// 512 cells per axis within `[lo, lo + 1/invExtent)`, followed by 3 bits of
+/// direction octant.
+uint32_t rayKey(const Ray& r, const Vec3& lo, const Vec3& invExtent)
+{
+    Vec3 q = glm::clamp((r.origin - lo) * invExtent, 0.0f, 1.0f) * 511.0f;
+    uint32_t morton = (expandBits((uint32_t)q.x) << 2)
+                    | (expandBits((uint32_t)q.y) << 1)
+                    | expandBits((uint32_t)q.z);
+    uint32_t octant = (r.direction.x < 0) << 2 | (r.direction.y < 0) << 1
+                    | (r.direction.z < 0);
+    return morton << 3 | octant;
+}
+
+} // namespace
+
+void WavefrontIntegrator::render()
+{
+    // The stage buffers are per thread, so every thread gets its own copy.
+    std::vector<WavefrontIntegrator> workers(omp_get_max_threads(), *this);
+    cam.forEachTile(tileSize, [&](int x0, int y0, int x1, int y1) {
+        workers[omp_get_thread_num()].renderTile(x0, y0, x1, y1);
+    });
+}
+
+void WavefrontIntegrator::renderTile(int x0, int y0, int x1, int y1)
+{
+    const int tileWidth  = x1 - x0;
+    const int tilePixels = tileWidth * (y1 - y0);
+    const int spp        = cam.samplesPerPixel;
+    const int samplesPerBatch =
+        std::clamp((int)(batchSize / tilePixels), 1, spp);
+
+    accum.assign(tilePixels, Color(0.0));
+    for (int s0 = 0; s0 < spp; s0 += samplesPerBatch) {
+        int samples = std::min(samplesPerBatch, spp - s0);
+        // Generate camera rays for all pixels and samples of this batch.
+        paths.resize(tilePixels * samples);
+        uint32_t idx = 0;
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                uint32_t pixel = (y - y0) * tileWidth + (x - x0);
+                for (int s = 0; s < samples; s++) {
+                    Path& path      = paths[idx++];
+                    path.ray        = cam.getRay(x, y);
+                    path.throughput = Color(1.0);
+                    path.radiance   = Color(0.0);
+                    path.pixel      = pixel;
+                }
+            }
+        }
+        tracePaths();
+        for (const Path& path : paths) accum[path.pixel] += path.radiance;
+    }
+
+    float sampleCoefficient = 1.0 / static_cast<float>(spp);
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            Color c = accum[(y - y0) * tileWidth + (x - x0)];
+            cam.img.setPixel(x, y, c * sampleCoefficient);
+        }
+    }
+}
+
+void WavefrontIntegrator::tracePaths()
+{
+    hits.resize(paths.size());
+    hitTypes.resize(paths.size());
+    queue.resize(paths.size());
+    for (uint32_t i = 0; i < paths.size(); i++) queue[i] = i;
+
+    // Like rayColor(), a path gathers nothing more once the depth is spent.
+    for (int depth = cam.maxDepth; depth > 0 && !queue.empty(); depth--) {
+        // Camera rays are already coherent in tile order.
+        if (cam.reorderRays && depth < cam.maxDepth) reorder();
+        extend();
+        shade();
+        // Continuation: only the compacted survivors are traced next bounce.
+        std::swap(queue, nextQueue);
+    }
+}
+
+void WavefrontIntegrator::extend()
+{
+    perf::Scope perfScope(perf::TRAVERSAL);
+    hitQueue.clear();
+    stats::add(stats::RAYS, queue.size());
+    for (uint32_t idx : queue) {
+        Path& path     = paths[idx];
+        HitRecord& rec = hits[idx];
+        if (!world.hit(path.ray, nearZero, infinity, rec)) {
+            path.radiance += path.throughput * cam.background;
+            continue;
+        }
+        hitTypes[idx] = rec.mat->type();
+        hitQueue.push_back(idx);
+    }
+}
+
+void WavefrontIntegrator::reorder()
+{
+    const size_t n = queue.size();
+    Vec3 lo(infinity), hi(-infinity);
+    for (uint32_t idx : queue) {
+        lo = glm::min(lo, paths[idx].ray.origin);
+        hi = glm::max(hi, paths[idx].ray.origin);
+    }
+    Vec3 extent = hi - lo;
+    Vec3 invExtent(
+        extent.x > 0 ? 1.0f / extent.x : 0.0f,
+        extent.y > 0 ? 1.0f / extent.y : 0.0f,
+        extent.z > 0 ? 1.0f / extent.z : 0.0f);
+
+    keys.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = rayKey(paths[queue[i]].ray, lo, invExtent);
+    }
+
+    // LSD radix sort of the 30 bit keys, 3 passes of 10 bits. Stable, so
+    // rays with equal keys keep their relative order.
+    const int radixBits = 10;
+    const uint32_t mask = (1u << radixBits) - 1;
+    sortScratch.resize(n);
+    keyScratch.resize(n);
+    std::vector<uint32_t> counts(1u << radixBits);
+    for (int shift = 0; shift < 30; shift += radixBits) {
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t i = 0; i < n; i++) counts[(keys[i] >> shift) & mask]++;
+        uint32_t sum = 0;
+        for (auto& c : counts) {
+            uint32_t count = c;
+            c              = sum;
+            sum += count;
+        }
+        for (size_t i = 0; i < n; i++) {
+            uint32_t dst     = counts[(keys[i] >> shift) & mask]++;
+            sortScratch[dst] = queue[i];
+            keyScratch[dst]  = keys[i];
+        }
+        std::swap(queue, sortScratch);
+        std::swap(keys, keyScratch);
+    }
+}
+
+void WavefrontIntegrator::shade()
+{
+    perf::Scope perfScope(perf::SHADING);
+    // Counting sort of the hits by material type.
+    constexpr int typeCount = static_cast<int>(MaterialType::OTHER) + 1;
+    std::array<uint32_t, typeCount + 1> offsets {};
+    for (uint32_t idx : hitQueue) offsets[(int)hitTypes[idx] + 1]++;
+    for (int t = 0; t < typeCount; t++) offsets[t + 1] += offsets[t];
+    std::array<uint32_t, typeCount> cursor;
+    std::copy(offsets.begin(), offsets.end() - 1, cursor.begin());
+    sortedHits.resize(hitQueue.size());
+    for (uint32_t idx : hitQueue) {
+        sortedHits[cursor[(int)hitTypes[idx]]++] = idx;
+    }
+
+    nextQueue.clear();
+    for (int t = 0; t < typeCount; t++) {
+        const uint32_t* begin = sortedHits.data() + offsets[t];
+        const uint32_t* end   = sortedHits.data() + offsets[t + 1];
+        if (begin == end) continue;
+        // Lambertian, Metal and Dielectric do not emit, so their stages only
+        // scatter.
+        switch (static_cast<MaterialType>(t)) {
+        case MaterialType::LAMBERTIAN:
+            scatterRange<Lambertian>(begin, end);
+            break;
+        case MaterialType::METAL: scatterRange<Metal>(begin, end); break;
+        case MaterialType::DIELECTRIC:
+            scatterRange<Dielectric>(begin, end);
+            break;
+        default: shadeRange(begin, end); break;
+        }
+    }
+}
+
+template <typename M>
+void WavefrontIntegrator::scatterRange(
+    const uint32_t* begin,
+    const uint32_t* end)
+{
+    Ray scattered;
+    Color attenuance;
+    for (const uint32_t* it = begin; it != end; it++) {
+        Path& path           = paths[*it];
+        const HitRecord& rec = hits[*it];
+        const M& mat         = static_cast<const M&>(*rec.mat);
+        if (!mat.M::scatter(path.ray.direction, rec, attenuance, scattered))
+            continue;
+        path.throughput *= attenuance;
+        path.ray = scattered;
+        nextQueue.push_back(*it);
+    }
+}
+
+void WavefrontIntegrator::shadeRange(const uint32_t* begin, const uint32_t* end)
+{
+    Ray scattered;
+    Color attenuance;
+    for (const uint32_t* it = begin; it != end; it++) {
+        Path& path           = paths[*it];
+        const HitRecord& rec = hits[*it];
+        path.radiance += path.throughput * rec.mat->emitted(rec);
+        if (!rec.mat->scatter(path.ray.direction, rec, attenuance, scattered))
+            continue;
+        path.throughput *= attenuance;
+        path.ray = scattered;
+        nextQueue.push_back(*it);
+    }
+}
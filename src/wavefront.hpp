@@ -0,0 +1,87 @@
+/// @file wavefront.hpp
+/// Wavefront (stream) path tracer.
+///
+/// Instead of following one path at a time through `Camera::rayColor()`, all
+/// paths of a tile are advanced one bounce at a time in separate stages:
+/// - extension: closest hit for every ray in the queue,
+/// - sort: hits are grouped by material type with a counting sort,
+/// - shading: one tight loop per material type, calling the concrete
+///   `scatter()` without virtual dispatch,
+/// - continuation: surviving paths are compacted into the next queue.
+///
+/// Optionally (Camera::reorderRays), the queue of secondary rays is sorted
+/// before each extension stage by the Morton code of the ray origin and the
+/// octant of the ray direction, so rays traversing the same parts of the BVH
+/// are traced after one another.
+///
+/// There is no light sampling in this renderer, so there are no shadow rays;
+/// emission is gathered when a path hits a light, exactly like rayColor().
+#pragma once
+
+#include "camera.hpp"
+#include "hittable.hpp"
+#include "material.hpp"
+#include "ray.hpp"
+#include "rtweekend.hpp"
+
+#include <cstdint>
+#include <vector>
+
+class WavefrontIntegrator {
+public:
+    WavefrontIntegrator(Camera& cam, const Hittable& world)
+        : cam(cam)
+        , world(world)
+    { }
+
+    /// @brief Render the whole image into `cam.img`. The camera must be
+    /// initialised.
+    void render();
+
+    /// @brief Upper limit of paths in flight per batch. A tile is split into
+    /// several batches of samples if it holds more paths than this.
+    size_t batchSize = 1 << 16;
+    int tileSize     = 16;
+
+private:
+    struct Path {
+        Ray ray;
+        Color throughput;
+        Color radiance;
+        uint32_t pixel; ///< Index into the tile's accumulation buffer
+    };
+
+    void renderTile(int x0, int y0, int x1, int y1);
+    /// @brief Trace a batch of paths until all are terminated or the depth
+    /// limit is reached, gathering their radiance.
+    void tracePaths();
+    /// @brief Extension stage: closest hit for all queued paths. Paths that
+    /// miss pick up the background and are dropped.
+    void extend();
+    /// @brief Sort the queue by ray key, see rayKey().
+    void reorder();
+    /// @brief Sort the hit queue by material type, then shade each type.
+    void shade();
+    /// @brief Shade a range of hits sharing the material type `M`, calling its
+    /// scatter() directly.
+    template <typename M>
+    void scatterRange(const uint32_t* begin, const uint32_t* end);
+    /// @brief Shade a range of hits of any material through the virtual
+    /// interface, including emission.
+    void shadeRange(const uint32_t* begin, const uint32_t* end);
+
+    Camera& cam;
+    const Hittable& world;
+
+    std::vector<Path> paths;
+    std::vector<HitRecord> hits;        ///< Per path, from the extension stage
+    std::vector<MaterialType> hitTypes; ///< Per path, material type of hit
+    std::vector<uint32_t> queue;        ///< Active paths
+    std::vector<uint32_t> hitQueue;     ///< Paths that hit something
+    std::vector<uint32_t> sortedHits;   ///< hitQueue sorted by material type
+    std::vector<uint32_t> nextQueue;    ///< Paths continuing next bounce
+    std::vector<uint32_t> keys;         ///< Per queue entry, for reorder()
+    std::vector<uint32_t> sortScratch;  ///< Radix sort buffers
+    std::vector<uint32_t> keyScratch;
+    std::vector<Color> accum;           ///< Per pixel radiance sum of a tile
+};
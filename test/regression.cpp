@@ -0,0 +1,829 @@
+/// @file regression.cpp
+/// Regression tests: render every built-in scene small, with a fixed seed, and
+/// compare against the reference images in the given directory, then check
+/// that all BVH builders find the same closest hits as a brute force search.
+///
+/// Renders are deterministic for a given seed, whatever the thread count, so
+/// the megakernel integrator must reproduce its reference exactly (an image
+/// hash is compared). Primary ray packets and the wavefront integrator
+/// consume random numbers in a different order, so their images are compared
+/// by RMSE and PSNR against the same reference.
+///
+/// `regression <reference dir>` runs the tests, from the repository root (the
+/// scenes load resources/). `regression --update <reference dir>` rewrites
+/// the references, after an intended change of the output.
+///
+/// The OBJ loader is checked on a small file covering the face formats, the
+/// mesh cache on its mesh, and instances against the same triangles
+/// transformed into the world. The heatmap pass must leave the statistics of
+/// the render it follows untouched. Damaged scene caches must be reparsed.
+#include "acceleration/bvh1.hpp"
+#include "acceleration/bvh2.hpp"
+#include "acceleration/bvh3.hpp"
+#include "acceleration/bvh8.hpp"
+#include "acceleration/instance.hpp"
+#include "mesh.hpp"
+#include "scene.hpp"
+#include "sceneFile.hpp"
+#include "scenes.hpp"
+#include "stats.hpp"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// @brief Render settings of the tests, small enough to run in seconds.
+const int IMAGE_WIDTH       = 64;
+const int SAMPLES_PER_PIXEL = 16;
+const uint32_t SEED         = 1;
+
+/// @brief Scenes without lights, black on the default background, so they
+/// get a sky.
+const std::vector<int> UNLIT_SCENES = { 1, 2, 3, 4, 5 };
+
+/// @brief Renders that sample differently from the reference may differ from
+/// it by at most this times the noise, the RMSE between the reference and a
+/// render with another seed, plus one 8-bit step.
+const double MAX_NOISE_RATIO = 1.5;
+
+const int CROSS_CHECK_RAYS = 4096;
+const int TEST_INSTANCES   = 64;
+/// @brief Instances hit in object space, so their distances differ from
+/// those of the transformed triangles by rounding.
+const float MAX_INSTANCE_ERROR = 1e-4;
+/// @brief blikker_pt2 evaluates every centroid as a split candidate, which is
+/// quadratic in the primitive count, so larger scenes skip it.
+const size_t PT2_MAX_PRIMS = 4096;
+
+int failures = 0;
+
+void fail(const std::string& test, const std::string& message)
+{
+    std::cerr << "FAIL " << test << ": " << message << "\n";
+    failures++;
+}
+
+/// @brief 8-bit RGB image, rows in file order.
+struct Image8 {
+    int width  = 0;
+    int height = 0;
+    std::vector<uint8_t> rgb;
+};
+
+/// @brief Parse a plain (P3) PPM as written by PPMImage::writeImage().
+bool readPPM(std::istream& is, Image8& image)
+{
+    std::string magic;
+    int maxValue;
+    is >> magic >> image.width >> image.height >> maxValue;
+    if (!is || magic != "P3" || maxValue != 255) return false;
+    image.rgb.resize(size_t(image.width) * image.height * 3);
+    for (uint8_t& channel : image.rgb) {
+        int value;
+        is >> value;
+        channel = static_cast<uint8_t>(value);
+    }
+    return bool(is);
+}
+
+Image8 toImage8(PPMImage& img)
+{
+    std::stringstream ss;
+    img.writeImage(ss);
+    Image8 image;
+    readPPM(ss, image);
+    return image;
+}
+
+/// @brief FNV-1a of the pixel data.
+uint64_t hash(const Image8& image)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (uint8_t channel : image.rgb) {
+        h ^= channel;
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+double rmse(const Image8& a, const Image8& b)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < a.rgb.size(); i++) {
+        double d = double(a.rgb[i]) - double(b.rgb[i]);
+        sum += d * d;
+    }
+    return std::sqrt(sum / a.rgb.size());
+}
+
+double psnr(double rmse)
+{
+    return rmse > 0.0 ? 20.0 * std::log10(255.0 / rmse) : INFINITY;
+}
+
+std::string hex(uint64_t h)
+{
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)h);
+    return buffer;
+}
+
+Image8 renderImage(Scene& scene)
+{
+    scene.cam.render(*scene.world);
+    return toImage8(scene.cam.img);
+}
+
+/// @brief Render scene `n` with every integrator and compare the images to
+/// the reference, or write the reference if `update` is set.
+void testScene(int n, const std::string& referenceDir, bool update)
+{
+    Scene scene;
+    buildScene(n, scene);
+    Camera& cam         = scene.cam;
+    cam.imageWidth      = IMAGE_WIDTH;
+    cam.samplesPerPixel = SAMPLES_PER_PIXEL;
+    cam.seed            = SEED;
+    if (std::find(UNLIT_SCENES.begin(), UNLIT_SCENES.end(), n)
+        != UNLIT_SCENES.end()) {
+        cam.background = Color(0.7, 0.8, 1.0);
+    }
+
+    std::string filename = referenceDir + "/" + scene.name + ".ppm";
+    Image8 image         = renderImage(scene);
+    if (update) {
+        std::ofstream f(filename);
+        if (!f.is_open()) {
+            fail(scene.name, "Failed to open file: " + filename);
+            return;
+        }
+        cam.img.writeImage(f);
+        std::cerr << "Wrote " << filename << "\n";
+        return;
+    }
+
+    Image8 reference;
+    std::ifstream f(filename);
+    if (!readPPM(f, reference)) {
+        fail(scene.name, "no reference image " + filename);
+        return;
+    }
+    if (reference.width != image.width || reference.height != image.height) {
+        fail(scene.name, "reference image has a different size");
+        return;
+    }
+
+    // Deterministic paths: the exact reference image
+    auto checkExact = [&](const std::string& test, const Image8& result) {
+        if (hash(result) != hash(reference)) {
+            fail(test,
+                 "hash " + hex(hash(result)) + " instead of "
+                     + hex(hash(reference)) + ", PSNR "
+                     + std::to_string(psnr(rmse(result, reference))) + " dB");
+        } else {
+            std::cerr << "ok   " << test << " " << hex(hash(result)) << "\n";
+        }
+    };
+    checkExact(scene.name + "/megakernel", image);
+
+    int threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    checkExact(scene.name + "/megakernel-1-thread", renderImage(scene));
+    omp_set_num_threads(threads);
+
+    // Stochastic paths: as close to the reference as another seed is
+    cam.seed        = SEED + 1;
+    double noise    = rmse(renderImage(scene), reference);
+    cam.seed        = SEED;
+    double maxError = MAX_NOISE_RATIO * noise + 1.0;
+    auto checkClose = [&](const std::string& test, const Image8& result) {
+        double error        = rmse(result, reference);
+        std::string metrics = "RMSE " + std::to_string(error) + " (max "
+                            + std::to_string(maxError) + "), PSNR "
+                            + std::to_string(psnr(error)) + " dB";
+        if (error > maxError) {
+            fail(test, metrics);
+        } else {
+            std::cerr << "ok   " << test << " " << metrics << "\n";
+        }
+    };
+    cam.primaryPackets = true;
+    checkClose(scene.name + "/packets", renderImage(scene));
+    cam.primaryPackets = false;
+    cam.integrator     = Camera::Integrator::WAVEFRONT;
+    checkClose(scene.name + "/wavefront", renderImage(scene));
+    cam.reorderRays = true;
+    checkClose(scene.name + "/wavefront-reorder", renderImage(scene));
+}
+
+/// @brief Closest hit of a ray, found by a brute force search.
+struct ExpectedHit {
+    Ray ray;
+    bool hit;
+    float t;
+};
+
+/// @brief Check that `bvh` finds the expected closest hit of every ray.
+void crossCheck(
+    const std::string& test,
+    const Hittable& bvh,
+    const std::vector<ExpectedHit>& expected)
+{
+    int mismatches = 0;
+    for (const ExpectedHit& e : expected) {
+        HitRecord rec;
+        bool hit = bvh.hit(e.ray, 0.001, infinity, rec);
+        // The same primitive intersection code runs either way, so the
+        // distances must be equal, not just close.
+        if (hit != e.hit || (hit && rec.t != e.t)) mismatches++;
+    }
+    if (mismatches) {
+        fail(test,
+             std::to_string(mismatches) + " of "
+                 + std::to_string(expected.size())
+                 + " rays have a different closest hit");
+    } else {
+        std::cerr << "ok   " << test << "\n";
+    }
+}
+
+/// @brief Closest hits of CROSS_CHECK_RAYS rays from `makeRay`, by a brute
+/// force search over `prims`.
+std::vector<ExpectedHit> bruteForce(
+    const std::vector<shared_ptr<Primitive>>& prims,
+    const std::function<Ray()>& makeRay)
+{
+    std::vector<ExpectedHit> expected;
+    for (int i = 0; i < CROSS_CHECK_RAYS; i++) {
+        ExpectedHit e { makeRay(), false, infinity };
+        HitRecord rec;
+        for (const auto& prim : prims) {
+            if (prim->hit(e.ray, 0.001, e.t, rec)) {
+                e.hit = true;
+                e.t   = rec.t;
+            }
+        }
+        expected.push_back(e);
+    }
+    return expected;
+}
+
+/// @brief Closest hits of random rays from inside `bounds`, by a brute force
+/// search over `prims`.
+std::vector<ExpectedHit> bruteForce(
+    const std::vector<shared_ptr<Primitive>>& prims,
+    const Aabb& bounds)
+{
+    return bruteForce(prims, [&] {
+        Vec3 origin = bounds.min + randomVec3() * (bounds.max - bounds.min);
+        return Ray(origin, randomUnitVector());
+    });
+}
+
+/// @brief Cross-check every BVH builder on the primitives of scene `n`, with
+/// random rays starting inside their bounds.
+void testBVHs(int n)
+{
+    Scene scene;
+    buildScene(n, scene);
+    const auto& prims = scene.primitives;
+    if (prims.empty()) return;
+
+    Aabb bounds;
+    for (const auto& prim : prims) prim->growAABB(bounds);
+    seedRandom(SEED);
+    std::vector<ExpectedHit> expected = bruteForce(prims, bounds);
+
+    std::string test = scene.name + "/bvh/";
+    // blikker_basic only takes Triangle primitives
+    std::vector<shared_ptr<Triangle>> tris;
+    for (const auto& prim : prims) {
+        if (auto tri = std::dynamic_pointer_cast<Triangle>(prim)) {
+            tris.push_back(tri);
+        }
+    }
+    if (tris.size() == prims.size()) {
+        crossCheck(test + "blikker_basic", blikker_basic::BVH(tris), expected);
+    }
+    if (prims.size() <= PT2_MAX_PRIMS) {
+        crossCheck(test + "blikker_pt2", blikker_pt2::BVH(prims), expected);
+    }
+    crossCheck(test + "blikker_pt3", blikker_pt3::BVH(prims), expected);
+    crossCheck(test + "blikker_pt3-8wide", blikker_pt3::BVH8(prims), expected);
+    auto leafOrder = prims;
+    blikker_pt3::BVH finalized(leafOrder);
+    finalized.finalize(leafOrder);
+    crossCheck(test + "blikker_pt3-finalized", finalized, expected);
+    finalized.traversal = blikker_pt3::BVH::Traversal::ORDERED;
+    crossCheck(test + "blikker_pt3-ordered", finalized, expected);
+    finalized.traversal = blikker_pt3::BVH::Traversal::STACKLESS;
+    crossCheck(test + "blikker_pt3-stackless", finalized, expected);
+    finalized.traversal = blikker_pt3::BVH::Traversal::SHORT_STACK;
+    crossCheck(test + "blikker_pt3-short-stack", finalized, expected);
+}
+
+/// @brief The statistics after a render with heatmaps must be those of the
+/// same render without them.
+void testHeatmaps()
+{
+    std::string test = "heatmaps/stats";
+    Scene scene;
+    buildScene(1, scene);
+    Camera& cam         = scene.cam;
+    cam.imageWidth      = IMAGE_WIDTH;
+    cam.samplesPerPixel = 1;
+    cam.seed            = SEED;
+
+    stats::reset();
+    cam.render(*scene.world);
+    const stats::Counters plain = stats::total();
+    stats::reset();
+    cam.heatmaps = true;
+    cam.render(*scene.world);
+    const stats::Counters mapped = stats::total();
+    cam.heatmaps = false;
+
+    for (int c = 0; c < stats::RENDER_NS; c++) {
+        if (mapped.values[c] != plain.values[c]) {
+            fail(test,
+                 "counter " + std::to_string(c) + " is "
+                     + std::to_string(mapped.values[c]) + " instead of "
+                     + std::to_string(plain.values[c]) + " with heatmaps");
+            return;
+        }
+    }
+    std::cerr << "ok   " << test << "\n";
+}
+
+/// @brief Move triangles of a soup and cross-check the refitted BVH: once
+/// all of them a little, keeping the topology, and once those in a corner
+/// shuffled across it, which degrades the subtrees holding them until they
+/// are rebuilt.
+void testRefit()
+{
+    std::string test = "refit/";
+    seedRandom(SEED);
+    std::vector<shared_ptr<Triangle>> tris;
+    std::vector<shared_ptr<Primitive>> prims;
+    for (int i = 0; i < 4096; i++) {
+        Vec3 v0 = randomVec3(-10.0f, 10.0f);
+        tris.push_back(make_shared<Triangle>(
+            v0,
+            v0 + randomVec3(-0.5f, 0.5f),
+            v0 + randomVec3(-0.5f, 0.5f),
+            nullptr));
+        prims.push_back(tris.back());
+    }
+    // Finalized, as Scene::buildBVH() does before animating
+    blikker_pt3::BVH bvh(prims);
+    bvh.finalize(prims);
+    Aabb bounds;
+    for (const auto& prim : prims) prim->growAABB(bounds);
+    auto move = [&](float cornerMin, float cornerMax, float distance) {
+        for (const auto& tri : tris) {
+            const Vec3* v = tri->vertices;
+            if (glm::min(v[0], Vec3(cornerMax)) != v[0]
+                || glm::max(v[0], Vec3(cornerMin)) != v[0]) {
+                continue;
+            }
+            Vec3 d = randomVec3(-distance, distance);
+            d      = glm::clamp(v[0] + d, cornerMin, cornerMax) - v[0];
+            tri->setVertices(v[0] + d, v[1] + d, v[2] + d);
+        }
+    };
+
+    move(-infinity, infinity, 0.01);
+    if (bvh.refit(infinity) != blikker_pt3::BVH::RefitAction::REFIT) {
+        fail(test + "bounds", "rebuilt without a threshold");
+    }
+    crossCheck(test + "bounds", bvh, bruteForce(prims, bounds));
+
+    move(2.0, 10.0, 8.0);
+    if (bvh.refit(1.05) != blikker_pt3::BVH::RefitAction::PARTIAL_REBUILD
+        || bvh.degradation() > 1.05) {
+        fail(test + "rebuild", "degraded subtrees were not rebuilt");
+    }
+    crossCheck(test + "rebuild", bvh, bruteForce(prims, bounds));
+    // Parent links of the rebuilt subtrees
+    bvh.traversal = blikker_pt3::BVH::Traversal::STACKLESS;
+    crossCheck(test + "rebuild-stackless", bvh, bruteForce(prims, bounds));
+}
+
+/// @brief Chains of nodes of one triangle per leaf, restored as from a cache:
+/// one reaching BVH::maxDepth, which must be kept and traversed correctly by
+/// every traversal, down to the last bit of the short stack's restart trail,
+/// and one a level deeper, which must be rejected and built instead, as must
+/// primitive indices that are no permutation. Whatever unused node 1 holds
+/// must be ignored, also when refitting.
+void testDeep()
+{
+    using blikker_pt3::BVH;
+    std::string test = "bvh/deep/";
+    const int count  = BVH::maxDepth + 2;
+    std::vector<shared_ptr<Primitive>> prims;
+    for (int i = 0; i < count; i++) {
+        float x = std::pow(1.5f, float(i));
+        prims.push_back(make_shared<Triangle>(
+            Vec3(x, -1, -1), Vec3(x, 2, -1), Vec3(x, -1, 2), nullptr));
+    }
+    seedRandom(SEED);
+    std::vector<ExpectedHit> expected = bruteForce(prims, [&] {
+        // Along the axis, through the triangles, down to the deepest ones
+        Vec3 origin(
+            std::pow(1.5f, randomFloat(-1.0f, float(count))),
+            randomFloat(-0.5f, 0.5f),
+            randomFloat(-0.5f, 0.5f));
+        Vec3 d(randomFloat() < 0.5f ? -1 : 1, 0, 0);
+        return Ray(origin, d);
+    });
+
+    // Node 0 the root, then pairs of a leaf and the next inner node, over
+    // the first `leaves` primitives. Hits beyond them are missed.
+    auto chain = [&](int leaves) {
+        std::vector<BVH::Node> nodes(2 * leaves);
+        for (int i = 0; i < leaves; i++) {
+            BVH::Node& node = nodes[i ? 2 * i + 1 : 0];
+            for (int j = i; j < leaves; j++) prims[j]->growAABB(node.aabb);
+            if (i == leaves - 1) {
+                node.primCount    = 1;
+                node.firstPrimIdx = i;
+                continue;
+            }
+            BVH::Node& leaf    = nodes[2 * i + 2];
+            node.mLeftChildIdx = 2 * i + 2;
+            leaf.primCount     = 1;
+            leaf.firstPrimIdx  = i;
+            prims[i]->growAABB(leaf.aabb);
+        }
+        return nodes;
+    };
+    std::vector<uint32_t> indices(count);
+    for (int i = 0; i < count; i++) indices[i] = i;
+
+    // Only the deepest level is left out, so expect the hits without it
+    std::vector<shared_ptr<Primitive>> shallowPrims(
+        prims.begin(), prims.end() - 1);
+    int next                      = 0;
+    std::vector<ExpectedHit> kept = bruteForce(
+        shallowPrims, [&] { return expected[next++].ray; });
+    std::vector<BVH::Node> nodes = chain(count - 1);
+    BVH shallow(shallowPrims, nodes.data(), nodes.size(), indices.data());
+    if (shallow.getNodes()[3].left() != nodes[3].left()) {
+        fail(test + "max", "a chain of maxDepth levels was rejected");
+    }
+    const std::pair<const char*, BVH::Traversal> traversals[] = {
+        { "max", BVH::Traversal::STACK },
+        { "max-ordered", BVH::Traversal::ORDERED },
+        { "max-stackless", BVH::Traversal::STACKLESS },
+        { "max-short-stack", BVH::Traversal::SHORT_STACK },
+    };
+    for (const auto& [name, traversal] : traversals) {
+        shallow.traversal = traversal;
+        crossCheck(test + name, shallow, kept);
+    }
+    crossCheck(
+        test + "max-8wide", blikker_pt3::BVH8(shallowPrims, shallow), kept);
+
+    nodes = chain(count);
+    BVH rebuilt(prims, nodes.data(), nodes.size(), indices.data());
+    rebuilt.traversal = BVH::Traversal::SHORT_STACK;
+    crossCheck(test + "rebuilt", rebuilt, expected);
+
+    // Node 1 is unused, and ignored whatever it holds, even by refit()
+    nodes                 = chain(count - 1);
+    nodes[1].primCount    = 1000;
+    nodes[1].firstPrimIdx = UINT32_MAX - 1000;
+    BVH refitted(shallowPrims, nodes.data(), nodes.size(), indices.data());
+    refitted.refit(infinity);
+    crossCheck(test + "refit-node-1", refitted, kept);
+
+    // A primitive listed twice, which finalize() would move out twice
+    std::vector<uint32_t> duplicated = indices;
+    duplicated[1]                    = duplicated[0];
+    nodes                            = chain(count - 1);
+    auto leafOrder                   = shallowPrims;
+    BVH permuted(leafOrder, nodes.data(), nodes.size(), duplicated.data());
+    permuted.finalize(leafOrder);
+    crossCheck(test + "duplicates", permuted, kept);
+}
+
+/// @brief A BVH over no primitives, as scenes without any build, is hit by
+/// nothing whichever way it is traversed.
+void testEmpty()
+{
+    std::string test = "bvh/empty";
+    std::vector<shared_ptr<Primitive>> prims;
+    blikker_pt3::BVH bvh(prims);
+    Ray ray(Vec3(0, 0, 0), Vec3(0, 0, 1));
+    HitRecord rec;
+    bool hit = false;
+    for (auto traversal :
+         { blikker_pt3::BVH::Traversal::STACK,
+           blikker_pt3::BVH::Traversal::ORDERED,
+           blikker_pt3::BVH::Traversal::STACKLESS,
+           blikker_pt3::BVH::Traversal::SHORT_STACK }) {
+        bvh.traversal = traversal;
+        hit |= bvh.hit(ray, 0.001, infinity, rec);
+    }
+    hit |= blikker_pt3::BVH8(prims).hit(ray, 0.001, infinity, rec);
+    if (hit || bvh.refit() != blikker_pt3::BVH::RefitAction::REFIT) {
+        fail(test, "hit or rebuilt without primitives");
+    } else {
+        std::cerr << "ok   " << test << "\n";
+    }
+}
+
+/// @brief A quad and a triangle in two groups: corners with texture
+/// coordinates and normals, relative indices, and faces before the first
+/// `usemtl`.
+const char* OBJ_TEST_FILE = R"(# test
+v 0 0 0
+v 1 0 0
+v 1 1 0
+v 0 1 0
+vt 0 0
+vt 1 0
+vt 1 1
+vt 0 1
+vn 0 0 1
+f 1/1/1 2/2/1 3/3/1 4/4/1
+usemtl red
+vn 0 0 -1
+f -4/-4/-1 -2/-2/-1 -1/-1/-1
+usemtl
+f 1/1/1 3/3/1 4/4/1
+)";
+
+/// @brief Load OBJ_TEST_FILE and check the indexed mesh.
+void testObj()
+{
+    std::string test     = "mesh/obj";
+    std::string filename = (std::filesystem::temp_directory_path()
+                            / "rt-regression.obj")
+                               .string();
+    std::ofstream(filename) << OBJ_TEST_FILE;
+    auto mesh = Mesh::loadObj(filename);
+    std::filesystem::remove(filename);
+    if (!mesh) {
+        fail(test, "failed to load");
+        return;
+    }
+
+    // The quad is a fan of two triangles. Of the 9 corners, 4 are the quad's
+    // vertices, the triangle with the other normal has 3 more, and the last
+    // reuses the quad's.
+    std::string error;
+    if (mesh->triangleCount() != 4) error = "triangle count";
+    if (mesh->vertexCount() != 7) error = "vertex count";
+    if (!mesh->hasNormals() || !mesh->hasUVs()) error = "attributes";
+    if (mesh->groupCount() != 2 || mesh->groupName(1) != "red"
+        || mesh->group(1) != 0 || mesh->group(2) != 1
+        || mesh->group(3) != 0) {
+        error = "groups";
+    }
+    if (mesh->vertex(2, 1) != Vec3(1, 1, 0)) error = "relative indices";
+    if (error.empty()) {
+        std::cerr << "ok   " << test << "\n";
+    } else {
+        fail(test, "wrong " + error);
+    }
+}
+
+/// @brief Write OBJ_TEST_FILE's mesh to a cache and map it again, then check
+/// that a truncated cache and one with an index beyond the vertices are
+/// rejected.
+void testMeshCache()
+{
+    std::string test = "mesh/cache";
+    auto path        = std::filesystem::temp_directory_path();
+    std::string obj  = (path / "rt-regression-cache.obj").string();
+    std::string file = (path / "rt-regression.rtmesh").string();
+    std::ofstream(obj) << OBJ_TEST_FILE;
+    auto mesh = Mesh::loadObj(obj);
+    std::filesystem::remove(obj);
+
+    std::string error;
+    if (!mesh || !mesh->write(file)) {
+        error = "failed to write";
+    } else if (auto mapped = Mesh::load(file);
+               !mapped || mapped->vertex(3, 2) != mesh->vertex(3, 2)
+               || mapped->groupName(1) != "red") {
+        error = "mapped mesh differs";
+    } else {
+        MeshFileHeader header;
+        std::ifstream(file, std::ios::binary)
+            .read(reinterpret_cast<char*>(&header), sizeof(header));
+        // An index beyond the vertices
+        {
+            auto mode = std::ios::binary | std::ios::in | std::ios::out;
+            std::fstream f(file, mode);
+            uint32_t index = mesh->vertexCount();
+            f.seekp(header.indexOffset + 2 * sizeof(uint32_t));
+            f.write(reinterpret_cast<const char*>(&index), sizeof(index));
+        }
+        if (Mesh::load(file)) error = "corrupt index loaded";
+        std::filesystem::resize_file(file, header.indexOffset + 4);
+        if (Mesh::load(file)) error = "truncated cache loaded";
+    }
+    std::filesystem::remove(file);
+    if (error.empty()) {
+        std::cerr << "ok   " << test << "\n";
+    } else {
+        fail(test, error);
+    }
+}
+
+/// @brief Load a scene file twice, the second time from its cache, then
+/// damage a shape's material index and the scene name offset in the cache,
+/// which must be noticed and the file reparsed, and the BVH nodes, which
+/// must be built and stored again.
+void testSceneCache()
+{
+    std::string test = "scene/cache";
+    auto path        = std::filesystem::temp_directory_path();
+    auto cacheDir    = path / "rt-regression-scenes";
+    std::string file = (path / "rt-regression.scene").string();
+    std::filesystem::remove_all(cacheDir);
+    std::ofstream(file) << "material red lambertian 1 0 0\n"
+                           "sphere 0 0 -1 0.5 red\n"
+                           "triangle 0 0 0 1 0 0 0 1 0 red\n";
+
+    std::string error;
+    Scene parsed, cached;
+    if (!loadSceneFile(file, parsed, cacheDir.string())
+        || !loadSceneFile(file, cached, cacheDir.string())) {
+        error = "failed to load";
+    } else if (cached.primitives.size() != 2 || cached.name != parsed.name) {
+        error = "cached scene differs";
+    } else if (parsed.bvhCached || !cached.bvhCached) {
+        error = "BVH not restored from the cache";
+    }
+    std::string cacheFile;
+    for (const auto& entry : std::filesystem::directory_iterator(cacheDir)) {
+        if (entry.path().extension() == ".rtscene") {
+            cacheFile = entry.path().string();
+        }
+    }
+    SceneCacheHeader header;
+    std::ifstream(cacheFile, std::ios::binary)
+        .read(reinterpret_cast<char*>(&header), sizeof(header));
+    auto patch = [&](uint64_t offset, uint32_t value) {
+        auto mode = std::ios::binary | std::ios::in | std::ios::out;
+        std::fstream f(cacheFile, mode);
+        f.seekp(offset);
+        f.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    auto damage = [&](uint64_t offset, uint32_t value, const char* what) {
+        if (!error.empty()) return;
+        std::vector<char> saved;
+        {
+            std::ifstream in(cacheFile, std::ios::binary);
+            saved.assign(std::istreambuf_iterator<char>(in), {});
+        }
+        patch(offset, value);
+        Scene scene;
+        if (!loadSceneFile(file, scene, cacheDir.string())
+            || scene.primitives.size() != 2 || scene.name != parsed.name) {
+            error = std::string("damaged ") + what + " not reparsed";
+        }
+        std::ofstream(cacheFile, std::ios::binary)
+            .write(saved.data(), saved.size());
+    };
+    damage(
+        header.shapes.offset + offsetof(ShapeRecord, material),
+        1000,
+        "material index");
+    damage(offsetof(SceneCacheHeader, name), 1u << 30, "name offset");
+    if (error.empty()) {
+        // A root leaf of more primitives than there are
+        using Node = blikker_pt3::BVH::Node;
+        patch(header.nodes.offset + offsetof(Node, primCount), 1000);
+        Scene rebuilt, reloaded;
+        if (!loadSceneFile(file, rebuilt, cacheDir.string())
+            || rebuilt.bvhCached
+            || !loadSceneFile(file, reloaded, cacheDir.string())
+            || !reloaded.bvhCached) {
+            error = "invalid BVH nodes not built and stored again";
+        }
+    }
+    std::filesystem::remove_all(cacheDir);
+    std::filesystem::remove(file);
+    if (error.empty()) {
+        std::cerr << "ok   " << test << "\n";
+    } else {
+        fail(test, error);
+    }
+}
+
+/// @brief Cross-check a TLAS of randomly placed, rotated and scaled instances
+/// of a small BLAS against a brute force search over its triangles
+/// transformed into the world.
+void testInstances()
+{
+    std::string test = "instance/tlas";
+    seedRandom(SEED);
+    std::vector<shared_ptr<Triangle>> object;
+    for (int i = 0; i < 16; i++) {
+        Vec3 v0 = randomVec3(-1.0f, 1.0f);
+        object.push_back(make_shared<Triangle>(
+            v0,
+            v0 + randomVec3(-0.5f, 0.5f),
+            v0 + randomVec3(-0.5f, 0.5f),
+            nullptr));
+    }
+    auto blas = make_shared<BLAS>(
+        std::vector<shared_ptr<Primitive>>(object.begin(), object.end()));
+
+    std::vector<shared_ptr<Primitive>> instances;
+    std::vector<shared_ptr<Primitive>> flattened;
+    for (int i = 0; i < TEST_INSTANCES; i++) {
+        float angle       = randomFloat(0.0f, 2 * pi);
+        Transform toWorld = Transform::translate(randomVec3(-8.0f, 8.0f))
+                          * Transform::rotate(randomUnitVector(), angle)
+                          * Transform::scale(randomVec3(0.5f, 2.0f));
+        instances.push_back(make_shared<Instance>(blas, toWorld));
+        for (const auto& tri : object) {
+            flattened.push_back(make_shared<Triangle>(
+                toWorld.point(tri->vertices[0]),
+                toWorld.point(tri->vertices[1]),
+                toWorld.point(tri->vertices[2]),
+                nullptr));
+        }
+    }
+    blikker_pt3::BVH tlas(instances);
+
+    int mismatches = 0;
+    for (int i = 0; i < CROSS_CHECK_RAYS; i++) {
+        Ray ray(randomVec3(-10.0f, 10.0f), randomUnitVector());
+        HitRecord expected, rec;
+        bool expectedHit = false;
+        float closest    = infinity;
+        for (const auto& prim : flattened) {
+            if (prim->hit(ray, 0.001, closest, expected)) {
+                expectedHit = true;
+                closest     = expected.t;
+            }
+        }
+        bool hit = tlas.hit(ray, 0.001, infinity, rec);
+        float error = std::abs(rec.t - closest);
+        if (hit != expectedHit
+            || (hit && error > MAX_INSTANCE_ERROR * closest)) {
+            mismatches++;
+        }
+    }
+    if (mismatches) {
+        fail(test,
+             std::to_string(mismatches) + " of "
+                 + std::to_string(CROSS_CHECK_RAYS)
+                 + " rays have a different closest hit");
+    } else {
+        std::cerr << "ok   " << test << "\n";
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    bool update = argc == 3 && std::string(argv[1]) == "--update";
+    if (argc != 2 && !update) {
+        std::cerr << "Usage: " << argv[0] << " [--update] <reference dir>\n";
+        return 2;
+    }
+    std::string referenceDir = argv[argc - 1];
+
+    for (int n = 1; n <= N_SCENES; n++) {
+        testScene(n, referenceDir, update);
+        if (!update) testBVHs(n);
+    }
+    if (!update) {
+        testHeatmaps();
+        testRefit();
+        testEmpty();
+        testDeep();
+        testObj();
+        testMeshCache();
+        testSceneCache();
+        testInstances();
+    }
+
+    if (failures) {
+        std::cerr << failures << " test(s) failed\n";
+        return 1;
+    }
+    return 0;
+}